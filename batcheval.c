@@ -0,0 +1,186 @@
+#include "defs.h"
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+/*
+ * Evaluate many positions at once, for offline jobs such as labeling
+ * datasets and tuning that score millions of positions. The positions are
+ * stored in a PositionBatch (see defs.h) instead of in Boards, so there are no
+ * incremental updates or tables to set up, and each position is scored from
+ * its bitboards alone.
+ *
+ * The score of a batch position is the material and piece-square part of
+ * evaluatePosition(): the sums of pieceValue[][][] for both sides, blended by
+ * the game phase. The pawn structure, material table, and NNUE terms need a
+ * Board and its tables, so they are not included.
+ *
+ * Instead of looping over the bits of each bitboard, each bitboard is split
+ * into its 8 rank bytes and the sum of the values of every piece on a rank is
+ * looked up in rankScores[piece][rank][byte]. That is 96 lookups per position
+ * no matter how many pieces are on the board, and with AVX2 the lookups for 8
+ * positions are done at once with gather instructions.
+ */
+#define BATCH_WIDTH 8
+
+/*
+ * rankScores[piece][rank][byte] is the sum of pieceValue[][piece][sq] over
+ * every square of the rank whose bit is set in the byte, from white's
+ * perspective (negative for black pieces). The middlegame and endgame sums
+ * are packed into one integer (see packScore()) so that a single lookup gives
+ * both. Filled in by initBatchEvaluation().
+ */
+static int rankScores[NUM_PIECE_TYPES][8][256];
+
+/*
+ * Pack a middlegame score and an endgame score into one integer: the
+ * middlegame score in the upper 16 bits and the endgame score in the lower 16
+ * bits. Packed scores can be added and subtracted like normal integers, as
+ * long as both halves of the result fit in 16 bits. A negative endgame score
+ * borrows from the upper half, which unpackScore() adds back.
+ */
+static int packScore(int mg, int eg) {
+    return mg * 0x10000 + eg;
+}
+static void unpackScore(int score, int* mg, int* eg) {
+    *eg = (short) (score & 0xFFFF);
+    *mg = (score - *eg) / 0x10000;
+}
+
+/*
+ * Call this function once at the start of the program, after
+ * initEvaluation(), to fill the rankScores table from the pieceValue table.
+ */
+void initBatchEvaluation() {
+    for (int piece = 0; piece < NUM_PIECE_TYPES; ++piece) {
+        int sign = pieceColor[piece] == WHITE ? 1 : -1;
+        for (int rank = 0; rank < 8; ++rank) {
+            for (int byte = 0; byte < 256; ++byte) {
+                int mg = 0, eg = 0;
+                for (int file = 0; file < 8; ++file) {
+                    if (byte & (1 << file)) {
+                        mg += pieceValue[MIDDLEGAME][piece][rank * 8 + file];
+                        eg += pieceValue[ENDGAME][piece][rank * 8 + file];
+                    }
+                }
+                rankScores[piece][rank][byte] = packScore(sign * mg, sign * eg);
+            }
+        }
+    }
+}
+
+/*
+ * Copy the given board's position into the given index of the batch.
+ *
+ * batch:      The batch that is being filled. Its arrays must have room for
+ *             at least index + 1 positions.
+ * index:      The index of the position in the batch.
+ * board:      The board whose position is copied.
+ */
+void setBatchPosition(PositionBatch* batch, int index, const Board* board) {
+    assert(index >= 0 && index < batch->numPositions);
+    for (int piece = 0; piece < NUM_PIECE_TYPES; ++piece) {
+        batch->pieceBitboards[piece][index] = board->pieceBitboards[piece];
+    }
+    batch->sideToMove[index] = board->sideToMove;
+}
+
+/*
+ * Find the packed piece-square scores of BATCH_WIDTH positions starting at
+ * the given index using AVX2 gathers. _mm256_i64gather_epi32() takes 4 64-bit
+ * indices, so the bitboards of the 8 positions are loaded as two vectors of 4
+ * and the 4 scores from each half are combined into one vector of 8.
+ */
+#if defined(__AVX2__)
+static void accumulateWide(const PositionBatch* batch, int start,
+    int* packed) {
+    const __m256i byteMask = _mm256_set1_epi64x(0xFF);
+    __m256i sum = _mm256_setzero_si256();
+    for (int piece = 0; piece < NUM_PIECE_TYPES; ++piece) {
+        const uint64* bitboards = &batch->pieceBitboards[piece][start];
+        __m256i lo = _mm256_loadu_si256((const __m256i*) bitboards);
+        __m256i hi = _mm256_loadu_si256((const __m256i*) (bitboards + 4));
+        for (int rank = 0; rank < 8; ++rank) {
+            const int* table = rankScores[piece][rank];
+            __m128i scoresLo = _mm256_i64gather_epi32(table,
+                _mm256_and_si256(lo, byteMask), 4);
+            __m128i scoresHi = _mm256_i64gather_epi32(table,
+                _mm256_and_si256(hi, byteMask), 4);
+            __m256i scores = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(scoresLo), scoresHi, 1);
+            sum = _mm256_add_epi32(sum, scores);
+            lo = _mm256_srli_epi64(lo, 8);
+            hi = _mm256_srli_epi64(hi, 8);
+        }
+    }
+    _mm256_storeu_si256((__m256i*) packed, sum);
+}
+#endif
+
+/*
+ * Find the packed piece-square score of a single position with one lookup per
+ * rank of each bitboard. Empty bitboards (Ex: the queens after a trade) are
+ * skipped.
+ */
+static int accumulateOne(const PositionBatch* batch, int index) {
+    int sum = 0;
+    for (int piece = 0; piece < NUM_PIECE_TYPES; ++piece) {
+        uint64 bitboard = batch->pieceBitboards[piece][index];
+        for (int rank = 0; bitboard; ++rank, bitboard >>= 8) {
+            sum += rankScores[piece][rank][bitboard & 0xFF];
+        }
+    }
+    return sum;
+}
+
+/*
+ * Turn a packed piece-square score into an evaluation from the perspective of
+ * the side to move, blending the middlegame and endgame scores by the game
+ * phase the same way evaluatePosition() does.
+ */
+static int finishScore(const PositionBatch* batch, int index, int packed) {
+    int phase = 0;
+    for (int piece = 0; piece < NUM_PIECE_TYPES; ++piece) {
+        if (phaseWeight[piece]) {
+            phase += phaseWeight[piece]
+                * countBits(batch->pieceBitboards[piece][index]);
+        }
+    }
+    phase = phase < MAX_PHASE ? phase : MAX_PHASE;
+    int mg, eg;
+    unpackScore(packed, &mg, &eg);
+    int weight = phaseScale[phase];
+    int eval = (mg * weight + eg * ((1 << PHASE_SHIFT) - weight))
+        >> PHASE_SHIFT;
+    return batch->sideToMove[index] == WHITE ? eval : -eval;
+}
+
+/*
+ * Evaluate every position in the batch and write the evaluations to
+ * scores[], in the same order as the positions. Each evaluation is from the
+ * perspective of the position's side to move, in 100ths of a pawn, like
+ * evaluatePosition(). Positions are processed BATCH_WIDTH at a time with AVX2
+ * if it is available; the rest are processed one at a time.
+ *
+ * batch:      The positions to evaluate. Passed in as a const pointer which
+ *             must not be NULL.
+ * scores:     An array of at least batch->numPositions integers that the
+ *             evaluations are written to.
+ */
+void evaluateBatch(const PositionBatch* batch, int* scores) {
+    assert(batch != NULL && scores != NULL);
+    int i = 0;
+#if defined(__AVX2__)
+    int packed[BATCH_WIDTH];
+    for (; i + BATCH_WIDTH <= batch->numPositions; i += BATCH_WIDTH) {
+        accumulateWide(batch, i, packed);
+        for (int j = 0; j < BATCH_WIDTH; ++j) {
+            scores[i + j] = finishScore(batch, i + j, packed[j]);
+        }
+    }
+#endif
+    for (; i < batch->numPositions; ++i) {
+        scores[i] = finishScore(batch, i, accumulateOne(batch, i));
+    }
+}
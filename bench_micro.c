@@ -0,0 +1,293 @@
+#include "defs.h"
+
+#include <math.h>    // sqrt
+#include <stdio.h>   // printf, puts, fopen, fprintf, fclose
+#include <stdlib.h>  // atoi
+
+/*
+ * Microbenchmarks for the engine's hot primitives: move generation, making
+ * and unmaking moves, attack lookups, the evaluation, and position keys. Each
+ * primitive is run over the same fixed set of positions (openings,
+ * middlegames, and endgames) so that a change in speed can be traced to a
+ * single function.
+ *
+ * A pass runs the primitive once on every position (or every move or square
+ * of every position) and counts the operations. Each benchmark is first run
+ * for WARMUP_NS to warm up the caches and branch predictors and to find how
+ * many passes take about SAMPLE_NS. Then 'repetitions' samples of that many
+ * passes are timed, and the mean, standard deviation, and minimum of the time
+ * per operation are reported.
+ *
+ * The pawn and material tables are warm after the first pass, so
+ * evaluatePosition() is measured with table hits, as it mostly is in a
+ * search.
+ *
+ * Usage: bench_micro [repetitions] [results.json]
+ *
+ * The results are printed as a table, and written as JSON to results.json if
+ * it is given ("-" prints the JSON instead of the table).
+ */
+#define DEFAULT_REPETITIONS 10
+#define MAX_REPETITIONS 1000
+#define WARMUP_NS 200000000ULL
+#define SAMPLE_NS 50000000ULL
+
+static const char* const corpus[] = {
+    // openings
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r1bqkb1r/pp3ppp/2nppn2/8/3NP3/2N5/PPP2PPP/R1BQKB1R w KQkq - 0 6",
+    "rnbqkb1r/ppp2ppp/4pn2/3p2B1/2PP4/2N5/PP2PPPP/R2QKBNR b KQkq - 3 4",
+    // middlegames
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "2rq1rk1/pp1bppbp/3p1np1/4n3/3NP3/1BN1BP2/PPPQ2PP/2KR3R w - - 0 12",
+    // endgames
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "8/5pk1/6p1/R7/5P2/6P1/r4K2/8 w - - 0 40",
+    "6k1/5pp1/7p/8/8/6P1/5PKP/3q3Q w - - 0 45",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 50",
+};
+#define CORPUS_SIZE ((int) (sizeof(corpus) / sizeof(corpus[0])))
+
+static Board boards[CORPUS_SIZE];
+static MoveList moveLists[CORPUS_SIZE];
+
+// Results are added up here so that the compiler cannot drop the calls.
+static volatile uint64 sink;
+
+/*
+ * The passes of each benchmark. Each one returns the number of operations.
+ */
+static int benchGenerateMoves() {
+    MoveList list;
+    uint64 sum = 0;
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        generateAllMoves(&boards[i], &list);
+        sum += list.numMoves;
+    }
+    sink += sum;
+    return CORPUS_SIZE;
+}
+
+static int benchMakeUndo() {
+    int ops = 0;
+    uint64 sum = 0;
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        const MoveList* list = &moveLists[i];
+        for (int j = 0; j < list->numMoves; ++j) {
+            if (makeMove(&boards[i], list->moves[j])) {
+                sum += boards[i].positionKey;
+                undoMove(&boards[i]);
+            }
+        }
+        ops += list->numMoves;
+    }
+    sink += sum;
+    return ops;
+}
+
+static int benchSquareAttacked() {
+    uint64 sum = 0;
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        for (int sq = 0; sq < 64; ++sq) {
+            sum += squareAttacked(&boards[i], 1ULL << sq, WHITE);
+            sum += squareAttacked(&boards[i], 1ULL << sq, BLACK);
+        }
+    }
+    sink += sum;
+    return CORPUS_SIZE * 128;
+}
+
+// the sliding attack functions expect a piece on the square
+static int benchBishopAttacks() {
+    uint64 sum = 0;
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        uint64 occupied = boards[i].colorBitboards[BOTH_COLORS];
+        for (int sq = 0; sq < 64; ++sq) {
+            sum += getBishopAttacks(sq, occupied | (1ULL << sq));
+        }
+    }
+    sink += sum;
+    return CORPUS_SIZE * 64;
+}
+
+static int benchRookAttacks() {
+    uint64 sum = 0;
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        uint64 occupied = boards[i].colorBitboards[BOTH_COLORS];
+        for (int sq = 0; sq < 64; ++sq) {
+            sum += getRookAttacks(sq, occupied | (1ULL << sq));
+        }
+    }
+    sink += sum;
+    return CORPUS_SIZE * 64;
+}
+
+static int benchEvaluate() {
+    uint64 sum = 0;
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        sum += (uint64) evaluatePosition(&boards[i]);
+    }
+    sink += sum;
+    return CORPUS_SIZE;
+}
+
+static int benchPositionKey() {
+    uint64 sum = 0;
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        sum += generatePositionKey(&boards[i]);
+    }
+    sink += sum;
+    return CORPUS_SIZE;
+}
+
+typedef struct {
+    const char* name;
+    int (*pass)();
+} MicroBenchmark;
+
+static const MicroBenchmark benchmarks[] = {
+    { "generateAllMoves", benchGenerateMoves },
+    { "makeMove+undoMove", benchMakeUndo },
+    { "squareAttacked", benchSquareAttacked },
+    { "getBishopAttacks", benchBishopAttacks },
+    { "getRookAttacks", benchRookAttacks },
+    { "evaluatePosition", benchEvaluate },
+    { "generatePositionKey", benchPositionKey },
+};
+#define NUM_BENCHMARKS ((int) (sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+/*
+ * The time per operation of each sample of a benchmark, and statistics over
+ * the samples, in nanoseconds.
+ */
+typedef struct {
+    double samples[MAX_REPETITIONS];
+    double mean;
+    double stddev;
+    double min;
+} MicroResult;
+
+static MicroResult results[NUM_BENCHMARKS];
+
+/*
+ * Warm up the benchmark, then time 'repetitions' samples of it and compute
+ * the statistics.
+ */
+static void runBenchmark(const MicroBenchmark* bench, int repetitions,
+    MicroResult* result) {
+    int passes = 0;
+    uint64 start = getTimeNs(), elapsed;
+    do {
+        bench->pass();
+        ++passes;
+        elapsed = getTimeNs() - start;
+    } while (elapsed < WARMUP_NS);
+    uint64 perPass = elapsed / passes;
+    int passesPerSample = perPass > 0 && SAMPLE_NS / perPass > 1
+        ? (int) (SAMPLE_NS / perPass) : 1;
+
+    result->mean = 0.0;
+    result->min = 0.0;
+    for (int r = 0; r < repetitions; ++r) {
+        long long ops = 0;
+        start = getTimeNs();
+        for (int p = 0; p < passesPerSample; ++p) {
+            ops += bench->pass();
+        }
+        double ns = (double) (getTimeNs() - start) / (double) ops;
+        result->samples[r] = ns;
+        result->mean += ns;
+        result->min = r == 0 || ns < result->min ? ns : result->min;
+    }
+    result->mean /= repetitions;
+    double variance = 0.0;
+    for (int r = 0; r < repetitions; ++r) {
+        double diff = result->samples[r] - result->mean;
+        variance += diff * diff;
+    }
+    result->stddev = repetitions > 1
+        ? sqrt(variance / (repetitions - 1)) : 0.0;
+}
+
+/*
+ * Print the results as a table, with the standard deviation as a percentage
+ * of the mean.
+ */
+static void printTable() {
+    printf("%-20s %10s %8s %10s %14s\n", "primitive", "ns/op", "stddev",
+        "min ns/op", "ops/s");
+    for (int i = 0; i < NUM_BENCHMARKS; ++i) {
+        const MicroResult* result = &results[i];
+        printf("%-20s %10.2f %7.2f%% %10.2f %14.0f\n", benchmarks[i].name,
+            result->mean, 100.0 * result->stddev / result->mean, result->min,
+            1e9 / result->mean);
+    }
+}
+
+/*
+ * Write the results as JSON, including every sample, so that runs can be
+ * compared by scripts.
+ */
+static void writeJson(FILE* file, int repetitions) {
+    fprintf(file, "{\n  \"positions\": %d,\n  \"repetitions\": %d,\n",
+        CORPUS_SIZE, repetitions);
+    fprintf(file, "  \"benchmarks\": [\n");
+    for (int i = 0; i < NUM_BENCHMARKS; ++i) {
+        const MicroResult* result = &results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"ns_per_op\": %.3f, "
+            "\"stddev_ns\": %.3f, \"min_ns\": %.3f, \"ops_per_sec\": %.0f, "
+            "\"samples_ns\": [", benchmarks[i].name, result->mean,
+            result->stddev, result->min, 1e9 / result->mean);
+        for (int r = 0; r < repetitions; ++r) {
+            fprintf(file, r == 0 ? "%.3f" : ", %.3f", result->samples[r]);
+        }
+        fprintf(file, i + 1 < NUM_BENCHMARKS ? "]},\n" : "]}\n");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    int repetitions = argc > 1 ? atoi(argv[1]) : DEFAULT_REPETITIONS;
+    if (repetitions < 1 || repetitions > MAX_REPETITIONS) {
+        printf("Usage: bench_micro [repetitions (1 to %d)] [results.json]\n",
+            MAX_REPETITIONS);
+        return -1;
+    }
+    const char* jsonPath = argc > 2 ? argv[2] : NULL;
+    int jsonOnly = jsonPath != NULL && jsonPath[0] == '-'
+        && jsonPath[1] == '\0';
+    initializeAll();
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        if (!initBoardTables(&boards[i])
+            || !setBoardToFen(&boards[i], corpus[i])) {
+            printf("Error: main: Could not set up position %d.\n", i);
+            return -1;
+        }
+        generateAllMoves(&boards[i], &moveLists[i]);
+    }
+
+    for (int i = 0; i < NUM_BENCHMARKS; ++i) {
+        runBenchmark(&benchmarks[i], repetitions, &results[i]);
+    }
+    if (jsonOnly) {
+        writeJson(stdout, repetitions);
+    } else {
+        printTable();
+    }
+    if (jsonPath != NULL && !jsonOnly) {
+        FILE* file = fopen(jsonPath, "w");
+        if (file == NULL) {
+            puts("Error: main: Could not open the JSON file.");
+            return -1;
+        }
+        writeJson(file, repetitions);
+        fclose(file);
+    }
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        freeBoardTables(&boards[i]);
+    }
+    return 0;
+}
@@ -1,23 +1,136 @@
 #include "defs.h"
 
-#include <stdio.h>   // printf, puts, sscanf, sscanf_s
-#include <string.h>  // memset, strlen
+#include <stdio.h>   // puts, printf, putchar
+#include <string.h>  // memset, memcpy
 
 /*
- * Clear the board and set all board variables to their default value. The
- * default value for board.pieces[64] is NO_PIECE (-1). board.sideToMove is set
- * to BOTH_COLORS so that an error will be thrown if it is not changed to
- * either WHITE or BLACK when the board is set up. The default value of
- * everything else is 0.
+ * Allocate the tables that a board needs for searching and evaluating: the
+ * pvTable, pawnTable, materialTable, evalCache, and (if a network is loaded)
+ * the accumulator stack. The tables belong to whoever owns the board, not to
+ * the position: setBoardToFen() never allocates or frees them, so a board can
+ * be set to any number of positions while keeping the same tables. Call this
+ * function once on a new board and free the tables with freeBoardTables()
+ * when the board is no longer needed. Boards that are only used for move
+ * generation (Ex: perft) don't need tables, but must be zeroed before they are
+ * set up for the first time.
+ *
+ * board:      The board whose tables are allocated, passed in as a pointer.
+ *             The pointer must not be NULL. Anything stored in the board is
+ *             cleared.
+ *
+ * return:     1 if the tables were allocated, 0 otherwise.
+ */
+int initBoardTables(Board* board) {
+    assert(board != NULL);
+    memset(board, 0, sizeof(Board));
+    memset(board->pieces, NO_PIECE, sizeof(char) * 64);
+    if (!initHashTable(&board->pvTable)
+        || !initEvalCache(&board->evalCache)
+        || !initPawnTable(&board->pawnTable)
+        || !initMaterialTable(&board->materialTable)
+        || !initAccumulators(board)) {
+        freeBoardTables(board);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Free the tables allocated by initBoardTables(). The position on the board
+ * is kept, but the board can't be searched or evaluated until its tables are
+ * allocated again.
+ *
+ * board:      The board whose tables are freed. Must not be NULL.
+ */
+void freeBoardTables(Board* board) {
+    assert(board != NULL);
+    freeHashTable(&board->pvTable);
+    freePawnTable(&board->pawnTable);
+    freeMaterialTable(&board->materialTable);
+    freeEvalCache(&board->evalCache);
+    freeAccumulators(board);
+}
+
+/*
+ * Clear the position on the board and set the position variables to their
+ * default value. The default value for board.pieces[64] is NO_PIECE (-1).
+ * board.sideToMove is set to BOTH_COLORS so that an error will be thrown if it
+ * is not changed to either WHITE or BLACK when the board is set up. The
+ * default value of everything else is 0. The tables, the move history, and
+ * the search heuristics are left alone (the history is only read below ply and
+ * the heuristics are cleared before each search), so that setting up a
+ * position only touches the few hundred bytes that describe it.
  * 
  * board:       The board to be cleared, passed in as a pointer. The pointer
  *              must not be NULL.
  */
 static void resetBoard(Board* board) {
     assert(board != NULL);
-    memset(board, 0, sizeof(Board));
+    memset(board->pieceBitboards, 0, sizeof(board->pieceBitboards));
+    memset(board->colorBitboards, 0, sizeof(board->colorBitboards));
     memset(board->pieces, NO_PIECE, sizeof(char) * 64);
+    memset(board->material, 0, sizeof(board->material));
+    memset(board->pieceSquare, 0, sizeof(board->pieceSquare));
+    board->positionKey = board->pawnKey = board->materialKey = 0ULL;
+    board->phase = 0;
     board->sideToMove = BOTH_COLORS;
+    board->ply = board->searchPly = 0;
+    board->castlePerms = board->fiftyMoveCount = 0;
+    board->enPassantSquare = 0ULL;
+    board->accumulator = board->accumulatorStack;
+}
+
+/*
+ * Place a piece on an empty square while the board is being set up and update
+ * the board's material, piece-square sums, phase, and bitboards. The keys and
+ * the accumulator are computed once the whole position is known.
+ */
+static void placePiece(Board* board, int piece, int square) {
+    assert(board->pieces[square] == NO_PIECE);
+    int color = pieceColor[piece];
+    board->pieces[square] = (signed char) piece;
+    board->material[color] += material[piece];
+    board->pieceSquare[MIDDLEGAME][color] +=
+        pieceValue[MIDDLEGAME][piece][square];
+    board->pieceSquare[ENDGAME][color] +=
+        pieceValue[ENDGAME][piece][square];
+    board->phase += phaseWeight[piece];
+    board->pieceBitboards[piece] |= 1ULL << square;
+    board->colorBitboards[color] |= 1ULL << square;
+    board->colorBitboards[BOTH_COLORS] |= 1ULL << square;
+}
+
+/*
+ * Read a decimal number from the FEN string and move 'c' past it. Return -1
+ * if there are no digits or the number is too large to be a move counter.
+ */
+static int parseNumber(const char** c) {
+    int number = 0;
+    if (**c < '0' || **c > '9') {
+        return -1;
+    }
+    for (; **c >= '0' && **c <= '9'; ++*c) {
+        number = number * 10 + (**c - '0');
+        if (number > 100000) {
+            return -1;
+        }
+    }
+    return number;
+}
+
+/*
+ * Finish setting up a board once its pieces, side to move, castle perms, en
+ * passant square, and fifty move count are known: compute the hash keys and
+ * the accumulator from scratch.
+ */
+static void finishSetup(Board* board) {
+    board->positionKey = generatePositionKey(board);
+    board->pawnKey = generatePawnKey(board);
+    board->materialKey = generateMaterialKey(board);
+    if (board->accumulator != NULL) {
+        refreshAccumulator(board, board->accumulator);
+    }
+    assert(checkBoard(board));
 }
 
 /*
@@ -26,12 +139,20 @@ static void resetBoard(Board* board) {
  * position of a chess game. A FEN string has 6 parts: (1) the piece layout,
  * (2) side to move, (3) castling permissions for both sides, (4) en passant
  * square (if there is one), (5) the number of half moves since the last
- * capture or pawn move, and (6) the move number. After execution the board
- * should be a valid chess position that exactly matches the FEN string. If
- * something goes wrong the function prints an error message and returns 0.
+ * capture or pawn move, and (6) the move number. Parts 5 and 6 may be left
+ * out, as in EPD lines, in which case they default to 0 and 1; anything after
+ * the last part is ignored. After execution the board should be a valid chess
+ * position that exactly matches the FEN string. If something goes wrong the
+ * function prints an error message and returns 0.
+ *
+ * The string is read in a single pass, placing each piece as it is read, and
+ * nothing is allocated: the board's tables (see initBoardTables()) are kept
+ * as they are, and only the accumulator is recomputed for the new position.
+ * This keeps loading millions of positions (Ex: for labeling or tuning) cheap.
  * 
  * board:      The board to be set up, passed in as a pointer. The pointer must
- *             not be NULL.
+ *             not be NULL. The board must either have its tables allocated
+ *             by initBoardTables() or be zeroed.
  * fen:        The position to set the board to, passed in as a const char
  *             pointer. The pointer must not be NULL.
  * 
@@ -42,112 +163,268 @@ int setBoardToFen(Board* board, const char* fen) {
     assert(board != NULL);
     assert(fen != NULL);
     resetBoard(board);
-    char layout[128], side, castlePerms[8], enPassantSquare[4];
-    int fiftyMoveCount, moveNumber;
-#if defined(COMPILER_MSVS)
-    if (sscanf_s(fen, "%s %c %s %s %d %d", layout, 128, &side, 1, castlePerms,
-        8, enPassantSquare, 4, &fiftyMoveCount, &moveNumber) != 6) {
-#else
-    if (sscanf(fen, "%s %c %s %s %d %d", layout, &side, castlePerms,
-        enPassantSquare, &fiftyMoveCount, &moveNumber) != 6) {
-#endif
-        puts("Error: setBoardToFen: Could not parse or invalid FEN string.");
-        return 0;
+    const char* c = fen;
+    while (*c == ' ') {
+        ++c;
     }
 
-    // layout
-    int layoutLength = (int) strlen(layout), square = 56, numEmpty;
-    assert(layoutLength < 70);
-    for (int layoutPos = 0; layoutPos < layoutLength; ++layoutPos) {
-        switch(layout[layoutPos]) {
-            case 'P': board->pieces[square++] = WHITE_PAWN; break;
-            case 'N': board->pieces[square++] = WHITE_KNIGHT; break;
-            case 'B': board->pieces[square++] = WHITE_BISHOP; break;
-            case 'R': board->pieces[square++] = WHITE_ROOK; break;
-            case 'Q': board->pieces[square++] = WHITE_QUEEN; break;
-            case 'K': board->pieces[square++] = WHITE_KING; break;
-            case 'p': board->pieces[square++] = BLACK_PAWN; break;
-            case 'n': board->pieces[square++] = BLACK_KNIGHT; break;
-            case 'b': board->pieces[square++] = BLACK_BISHOP; break;
-            case 'r': board->pieces[square++] = BLACK_ROOK; break;
-            case 'q': board->pieces[square++] = BLACK_QUEEN; break;
-            case 'k': board->pieces[square++] = BLACK_KING; break;
-            case '/': square -= 16; break;
+    // layout, from rank 8 to rank 1 and from the A file to the H file
+    int rank = 7, file = 0;
+    for (; *c != ' '; ++c) {
+        int piece;
+        switch (*c) {
+            case 'P': piece = WHITE_PAWN; break;
+            case 'N': piece = WHITE_KNIGHT; break;
+            case 'B': piece = WHITE_BISHOP; break;
+            case 'R': piece = WHITE_ROOK; break;
+            case 'Q': piece = WHITE_QUEEN; break;
+            case 'K': piece = WHITE_KING; break;
+            case 'p': piece = BLACK_PAWN; break;
+            case 'n': piece = BLACK_KNIGHT; break;
+            case 'b': piece = BLACK_BISHOP; break;
+            case 'r': piece = BLACK_ROOK; break;
+            case 'q': piece = BLACK_QUEEN; break;
+            case 'k': piece = BLACK_KING; break;
+            case '/':
+                if (file != 8 || rank == 0) {
+                    puts("Error: setBoardToFen: Each rank must have 8 squares "
+                        "(layout)");
+                    return 0;
+                }
+                --rank;
+                file = 0;
+                continue;
             default:
-                numEmpty = layout[layoutPos] - '0';
-                if (numEmpty < 1 || numEmpty > 8) {
+                if (*c < '1' || *c > '8' || file + (*c - '0') > 8) {
                     puts("Error: setBoardToFen: Invalid character (layout)");
                     return 0;
                 }
-                square += numEmpty;
+                file += *c - '0';
+                continue;
         }
-    }
-    for (square = 0; square < 64; ++square) {
-        int piece = board->pieces[square];
-        if (board->pieces[square] != NO_PIECE) {
-            assert(piece >= 0 && piece < NUM_PIECE_TYPES);
-            board->material[pieceColor[piece]] += material[piece];
-            board->pieceBitboards[piece] |= (1ULL << square);
-            board->colorBitboards[pieceColor[piece]] |= (1ULL << square);
-            board->colorBitboards[BOTH_COLORS] |= (1ULL << square);
+        if (file == 8) {
+            puts("Error: setBoardToFen: Each rank must have 8 squares (layout)");
+            return 0;
         }
+        placePiece(board, piece, rank * 8 + file++);
+    }
+    if (rank != 0 || file != 8) {
+        puts("Error: setBoardToFen: The layout must have 8 ranks of 8 squares.");
+        return 0;
+    }
+    if (countBits(board->pieceBitboards[WHITE_KING]) != 1
+        || countBits(board->pieceBitboards[BLACK_KING]) != 1) {
+        puts("Error: setBoardToFen: Each side must have exactly one king.");
+        return 0;
+    }
+    while (*c == ' ') {
+        ++c;
     }
 
     // side to move
-    if (side != 'w' && side != 'b') {
+    if ((*c != 'w' && *c != 'b') || c[1] != ' ') {
         puts("Error: setBoardToFen: color char must be either 'w' or 'b'.");
         return 0;
     }
-    board->sideToMove = side == 'w' ? WHITE : BLACK;
+    board->sideToMove = *c == 'w' ? WHITE : BLACK;
+    ++c;
+    while (*c == ' ') {
+        ++c;
+    }
 
     // castle permissions
-    int castlePermsLength = (int) strlen(castlePerms); 
-    assert(castlePermsLength < 5);
-    for (int pos = 0; pos < castlePermsLength; ++pos) {
-        switch (castlePerms[pos]) {
-            case 'K': board->castlePerms |= CASTLE_WK; break;
-            case 'Q': board->castlePerms |= CASTLE_WQ; break;
-            case 'k': board->castlePerms |= CASTLE_BK; break;
-            case 'q': board->castlePerms |= CASTLE_BQ; break;
-            case '-': assert(pos == 0); break;
-            default:
-                puts("Error: setBoardToFen: Invalid character (castle perms)");
-                return 0;
+    if (*c == '-') {
+        ++c;
+    } else {
+        for (; *c != ' ' && *c != '\0'; ++c) {
+            switch (*c) {
+                case 'K': board->castlePerms |= CASTLE_WK; break;
+                case 'Q': board->castlePerms |= CASTLE_WQ; break;
+                case 'k': board->castlePerms |= CASTLE_BK; break;
+                case 'q': board->castlePerms |= CASTLE_BQ; break;
+                default:
+                    puts("Error: setBoardToFen: Invalid character (castle "
+                        "perms)");
+                    return 0;
+            }
         }
     }
+    if (*c != ' ') {
+        puts("Error: setBoardToFen: Invalid castle perms.");
+        return 0;
+    }
+    while (*c == ' ') {
+        ++c;
+    }
 
-    // en passant square
-    assert(strlen(enPassantSquare) < 3);
-    if (enPassantSquare[0] != '-') {
-        int file = enPassantSquare[0] - 'a';
-        int rank = enPassantSquare[1] - '1';
-        assert((side == 'w' && file == 5) || (side == 'b' && file == 2));
-        assert(rank >= 0 && rank < 8);
-        board->enPassantSquare = 1ULL << (file * 8 + rank);
+    // en passant square, which is on rank 6 if white is to move and on rank 3
+    // if black is to move
+    if (*c == '-') {
+        ++c;
+    } else {
+        int epFile = c[0] - 'a';
+        if (epFile < 0 || epFile > 7
+            || c[1] - '1' != (board->sideToMove == WHITE ? 5 : 2)) {
+            puts("Error: setBoardToFen: Invalid en passant square.");
+            return 0;
+        }
+        board->enPassantSquare = 1ULL << ((c[1] - '1') * 8 + epFile);
+        c += 2;
+    }
+    if (*c != ' ' && *c != '\0' && *c != '\n' && *c != '\r' && *c != ';') {
+        puts("Error: setBoardToFen: Invalid en passant square.");
+        return 0;
+    }
+    while (*c == ' ') {
+        ++c;
     }
 
-    // fifty move rule
+    // fifty move rule and move number, which are optional
+    int fiftyMoveCount = 0, moveNumber = 1;
+    if (*c >= '0' && *c <= '9') {
+        fiftyMoveCount = parseNumber(&c);
+        while (*c == ' ') {
+            ++c;
+        }
+        if (*c >= '0' && *c <= '9') {
+            moveNumber = parseNumber(&c);
+        }
+    }
     if (fiftyMoveCount < 0 || fiftyMoveCount > 100) {
         puts("Error: setBoardToFen: invalid half move clock (fifty move count "
         "must be between 0 and 100 inclusive)");
         return 0;
     }
     board->fiftyMoveCount = fiftyMoveCount;
-
-    // move number
     if (moveNumber < 1) {
         puts("Error: setBoardToFen: moveNumber must be >= 1");
         return 0;
     }
-    board->ply = 0;
-    board->searchPly = 0;
 
-    board->positionKey = generatePositionKey(board);
-    initHashTable(&board->pvTable);
-    assert(checkBoard(board));
+    finishSetup(board);
     return 1;
 }
 
+/*
+ * Pack the board's position into 32 bytes (see PackedPosition in defs.h).
+ * The pieces are stored in the order of the occupied squares, from A1 to H8,
+ * 4 bits each, so there must be at most 32 pieces on the board. The score,
+ * result, and best move are set to "unknown" and can be filled in by the
+ * caller.
+ *
+ * board:      The board whose position is packed. Must not be NULL.
+ * packed:     The packed position to be filled in. Must not be NULL.
+ */
+void packPosition(const Board* board, PackedPosition* packed) {
+    assert(board != NULL && packed != NULL);
+    assert(sizeof(PackedPosition) == 32);
+    uint64 occupied = board->colorBitboards[BOTH_COLORS];
+    assert(countBits(occupied) <= 32);
+    packed->occupancy = occupied;
+    memset(packed->pieces, 0, sizeof(packed->pieces));
+    for (int i = 0; occupied; ++i, occupied &= occupied - 1) {
+        int piece = board->pieces[getLSB(occupied)];
+        packed->pieces[i >> 1] |= (unsigned char) (piece << ((i & 1) * 4));
+    }
+    packed->score = PACKED_NO_SCORE;
+    packed->bestMove = 0;
+    packed->flags = (unsigned char) (board->sideToMove
+        | (board->castlePerms << 1));
+    packed->enPassantSquare = (unsigned char) (board->enPassantSquare != 0ULL
+        ? getLSB(board->enPassantSquare) : 0);
+    packed->fiftyMoveCount = (unsigned char) board->fiftyMoveCount;
+    packed->result = PACKED_NO_RESULT;
+}
+
+/*
+ * Set up a chessboard to a position packed by packPosition(). Like
+ * setBoardToFen(), nothing is allocated and the board's tables are kept. If
+ * the packed position is not valid the function prints an error message and
+ * returns 0.
+ *
+ * board:      The board to be set up. Must not be NULL, and must either have
+ *             its tables allocated by initBoardTables() or be zeroed.
+ * packed:     The packed position. Must not be NULL.
+ *
+ * return:     1 if the board was set to the packed position, 0 otherwise.
+ */
+int unpackPosition(Board* board, const PackedPosition* packed) {
+    assert(board != NULL && packed != NULL);
+    resetBoard(board);
+    uint64 occupied = packed->occupancy;
+    if (countBits(occupied) > 32) {
+        puts("Error: unpackPosition: More than 32 pieces.");
+        return 0;
+    }
+    for (int i = 0; occupied; ++i, occupied &= occupied - 1) {
+        int piece = (packed->pieces[i >> 1] >> ((i & 1) * 4)) & 0xF;
+        if (piece >= NUM_PIECE_TYPES) {
+            puts("Error: unpackPosition: Invalid piece code.");
+            return 0;
+        }
+        placePiece(board, piece, getLSB(occupied));
+    }
+    if (countBits(board->pieceBitboards[WHITE_KING]) != 1
+        || countBits(board->pieceBitboards[BLACK_KING]) != 1) {
+        puts("Error: unpackPosition: Each side must have exactly one king.");
+        return 0;
+    }
+    board->sideToMove = packed->flags & 1;
+    board->castlePerms = (packed->flags >> 1) & 0xF;
+    if (packed->enPassantSquare != 0) {
+        int rank = packed->enPassantSquare >> 3;
+        if (packed->enPassantSquare >= 64
+            || rank != (board->sideToMove == WHITE ? 5 : 2)) {
+            puts("Error: unpackPosition: Invalid en passant square.");
+            return 0;
+        }
+        board->enPassantSquare = 1ULL << packed->enPassantSquare;
+    }
+    if (packed->fiftyMoveCount > 100) {
+        puts("Error: unpackPosition: Invalid fifty move count.");
+        return 0;
+    }
+    board->fiftyMoveCount = packed->fiftyMoveCount;
+    finishSetup(board);
+    return 1;
+}
+
+/*
+ * Pack a move into 16 bits for PackedPosition.bestMove: the from square (6
+ * bits), the to square (6 bits), and the promoted piece (4 bits, 0xF if the
+ * move is not a promotion). A packed move is never 0, since the from and to
+ * squares are different, so 0 can mean "no move".
+ */
+unsigned short packMove(int move) {
+    return (unsigned short) ((move & 0xFFF) | (((move >> 16) & 0xF) << 12));
+}
+
+/*
+ * Find the move on the board that was packed by packMove(). The rest of the
+ * move (captured piece, flags, and move ordering score) depends on the
+ * position, so it is taken from the move generator.
+ *
+ * board:        The board the move is played on. Must not be NULL.
+ * packedMove:   The packed move.
+ *
+ * return:       The move, or 0 if packedMove is 0 or the board has no such
+ *               move.
+ */
+int unpackMove(const Board* board, unsigned short packedMove) {
+    assert(board != NULL);
+    if (packedMove == 0) {
+        return 0;
+    }
+    MoveList list;
+    generateAllMoves(board, &list);
+    for (int i = 0; i < list.numMoves; ++i) {
+        if (packMove(list.moves[i]) == packedMove) {
+            return list.moves[i];
+        }
+    }
+    return 0;
+}
+
 /*
  * Remove the piece from the given square and update the given board's member
  * variables to reflect the change.
@@ -167,7 +444,19 @@ static void clearPiece(Board* board, int square) {
     board->colorBitboards[BOTH_COLORS] &= clearMask;
     board->pieces[square] = NO_PIECE;
     board->positionKey ^= getPieceHashKey(piece, square);
+    if (piece == WHITE_PAWN || piece == BLACK_PAWN) {
+        board->pawnKey ^= getPieceHashKey(piece, square);
+    }
     board->material[pieceColor[piece]] -= material[piece];
+    board->materialKey -= 1ULL << (4 * piece);
+    if (board->accumulator != NULL) {
+        removeFeature(board->accumulator, piece, square);
+    }
+    board->pieceSquare[MIDDLEGAME][pieceColor[piece]] -=
+        pieceValue[MIDDLEGAME][piece][square];
+    board->pieceSquare[ENDGAME][pieceColor[piece]] -=
+        pieceValue[ENDGAME][piece][square];
+    board->phase -= phaseWeight[piece];
 }
 
 /*
@@ -191,13 +480,25 @@ static void addPiece(Board* board, int square, int piece) {
     board->colorBitboards[BOTH_COLORS] |= setMask;
     board->pieces[square] = (char) piece;
     board->positionKey ^= getPieceHashKey(piece, square);
+    if (piece == WHITE_PAWN || piece == BLACK_PAWN) {
+        board->pawnKey ^= getPieceHashKey(piece, square);
+    }
     board->material[pieceColor[piece]] += material[piece];
+    board->materialKey += 1ULL << (4 * piece);
+    if (board->accumulator != NULL) {
+        addFeature(board->accumulator, piece, square);
+    }
+    board->pieceSquare[MIDDLEGAME][pieceColor[piece]] +=
+        pieceValue[MIDDLEGAME][piece][square];
+    board->pieceSquare[ENDGAME][pieceColor[piece]] +=
+        pieceValue[ENDGAME][piece][square];
+    board->phase += phaseWeight[piece];
 }
 
 /*
  * Move a piece from the square 'from' to the square 'to' and update the given
- * board's pieceBitboards, colorBitboards, and pieces arrays to reflect the
- * change.
+ * board's pieceBitboards, colorBitboards, pieces, and pieceSquare arrays to
+ * reflect the change.
  *
  * board:      The board that is being updated, passed in as a pointer. The
  *             pointer must not be NULL.
@@ -224,6 +525,19 @@ static void movePiece(Board* board, int from, int to) {
     board->pieces[from] = NO_PIECE;
     board->positionKey ^= getPieceHashKey(piece, from);
     board->positionKey ^= getPieceHashKey(piece, to);
+    if (piece == WHITE_PAWN || piece == BLACK_PAWN) {
+        board->pawnKey ^= getPieceHashKey(piece, from);
+        board->pawnKey ^= getPieceHashKey(piece, to);
+    }
+    int color = pieceColor[piece];
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        board->pieceSquare[phase][color] += pieceValue[phase][piece][to]
+            - pieceValue[phase][piece][from];
+    }
+    if (board->accumulator != NULL) {
+        removeFeature(board->accumulator, piece, from);
+        addFeature(board->accumulator, piece, to);
+    }
 }
 
 /*
@@ -270,6 +584,7 @@ static const int castlePerms[64] = {
 int makeMove(Board* board, int move) {
     assert(checkBoard(board));
     assert(validMove(move));
+    PROFILE_BEGIN(PHASE_MAKE_UNDO);
     int from = move & 0x3F;
     int to = (move >> 6) & 0x3F;
     board->history[board->ply].move = move;
@@ -278,6 +593,10 @@ int makeMove(Board* board, int move) {
     board->history[board->ply].fiftyMoveCount = board->fiftyMoveCount;
     board->history[board->ply++].positionKey = board->positionKey;
     ++board->searchPly;
+    if (board->accumulator != NULL) {
+        memcpy(board->accumulator + 1, board->accumulator, sizeof(Accumulator));
+        ++board->accumulator;
+    }
     if (board->enPassantSquare != 0ULL) {
         int square = getLSB(board->enPassantSquare);
         board->positionKey ^= getEnPassantHashKey(square);
@@ -322,13 +641,20 @@ int makeMove(Board* board, int move) {
     }
     movePiece(board, from, to);
     board->positionKey ^= getSideHashKey();
+    // The position key is final, so start loading the table entries of the new
+    // position while the legality check runs.
+    prefetchHashTable(&board->pvTable, board->positionKey);
+    prefetchEvalCache(&board->evalCache, board->positionKey);
     int king = board->sideToMove == WHITE ? WHITE_KING : BLACK_KING;
     board->sideToMove = !board->sideToMove;
     assert(checkBoard(board));
+    PROFILE_SWITCH(PHASE_LEGALITY);
     if (!squareAttacked(board, board->pieceBitboards[king], board->sideToMove)) {
+        PROFILE_END();
         return 1;
     }
     undoMove(board);
+    PROFILE_END();
     return 0;
 }
 
@@ -346,11 +672,16 @@ int makeMove(Board* board, int move) {
 void undoMove(Board* board) {
     assert(checkBoard(board));
     assert(board->ply > 0);
+    PROFILE_BEGIN(PHASE_MAKE_UNDO);
     board->sideToMove = !board->sideToMove;
     --board->searchPly;
     int move = board->history[--board->ply].move;
     int from = move & 0x3F;
     int to = (move >> 6) & 0x3F;
+    // The accumulator from before the move is still on the stack, so pop it
+    // instead of updating the accumulator while the pieces are moved back.
+    Accumulator* accumulator = board->accumulator;
+    board->accumulator = NULL;
     movePiece(board, to, from);
     switch (move & MOVE_FLAGS) {
         case CAPTURE_FLAG:
@@ -381,5 +712,35 @@ void undoMove(Board* board) {
     board->fiftyMoveCount = board->history[board->ply].fiftyMoveCount;
     board->enPassantSquare = board->history[board->ply].enPassantSquare;
     board->positionKey = board->history[board->ply].positionKey;
+    board->accumulator = accumulator == NULL ? NULL : accumulator - 1;
     assert(checkBoard(board));
+    PROFILE_END();
+}
+
+/*
+ * Print an 8x8 grid of pieces to the console. If there is not a piece on a
+ * square, print '-'. The board will be printed from white's perspective (8th
+ * rank on top, 1st rank on the bottom, A file on the left, and H file on the
+ * right).
+ * 
+ * board:       The board whose pieces will be printed to the console. Passed
+ *              in as a pointer which must not be NULL.
+ */
+void printPieces(const Board* board) {
+    assert(board != NULL);
+    const char* pieceChar = "PNBRQKpnbrqk";
+    int rank = 8;
+    for (int square = 56; square >= 0; square -= 8) {
+        printf("%d  ", rank--);
+        for (int fileIndex = 0; fileIndex < 8; ++fileIndex) {
+            int piece = board->pieces[square + fileIndex];
+            printf("%c ", piece == NO_PIECE ? '-' : pieceChar[piece]);
+        }
+        putchar('\n');
+    }
+    printf("\n  ");
+    for (int i = 0; i < 8; ++i) {
+        printf(" %c", (char) ('a' + i));
+    }
+    putchar('\n');
 }
@@ -0,0 +1,368 @@
+#include "defs.h"
+
+#include <stdio.h>   // printf, puts, fopen, fwrite, fclose
+#include <stdlib.h>  // malloc, realloc, calloc, free, atoi
+#include <string.h>  // memchr
+
+#include "libs/tinycthread.h"
+
+/*
+ * Convert a PGN file of games into a file of packed positions (see
+ * PackedPosition in defs.h) for training. Every position of every game is
+ * written with the move that was played from it (as bestMove) and the result
+ * of the game, except for:
+ *
+ *     - the first few plies of each game (the opening book part),
+ *     - positions where the side to move is in check, and
+ *     - positions that were already written (by their Zobrist key).
+ *
+ * Games that start from a FEN tag with more than 32 pieces are skipped, since
+ * a PackedPosition can't hold them.
+ *
+ * The PGN file is mapped into memory and split into chunks of about
+ * CHUNK_SIZE bytes. Each chunk is moved forward to the start of a game (a
+ * tag pair line after the moves of the previous game), so every game is in
+ * exactly one chunk. The chunks are converted on worker threads, each with
+ * its own board, and the main thread writes them to the output file in the
+ * order they appear in the PGN file, so the output is the same no matter how
+ * many threads are used. The main thread also removes the duplicates, since
+ * it sees every position in order.
+ *
+ * Converted chunks are kept in a ring of 2 slots per thread whose buffers are
+ * reused, so after the first few chunks nothing is allocated and at most a
+ * few chunks of positions are in memory at once. A worker waits for a free
+ * slot if it gets too far ahead of the main thread.
+ *
+ * Usage: convert <games.pgn> <output.bin> [threads] [min ply]
+ */
+#define MAX_THREADS 128
+#define SLOTS_PER_THREAD 2
+#define CHUNK_SIZE (4 << 20)
+#define INITIAL_CAPACITY (1 << 16)
+#define DEFAULT_MIN_PLY 8
+
+/*
+ * The duplicates are found with a table of the keys of the positions that
+ * have been written, indexed by the low bits of the key. Like the hash tables
+ * in hashtable.c, a new key replaces whatever was in its entry, so the memory
+ * stays fixed (2^DEDUP_BITS keys, 128 MB) and only a few duplicates of
+ * positions seen long ago get through.
+ */
+#define DEDUP_BITS 24
+
+/*
+ * A chunk of the PGN file and the positions converted from it.
+ *
+ * start, end:      The part of the PGN file in the chunk.
+ * positions:       The positions that passed the filters, in game order.
+ * keys:            The Zobrist key of each position, for removing duplicates.
+ * numPositions:    The number of positions in the chunk.
+ * capacity:        The number of positions the buffers have room for.
+ * numGames:        The number of games in the chunk.
+ * numErrors:       The number of games that were cut short by an invalid FEN
+ *                  tag (or one with more than 32 pieces) or move. The
+ *                  positions before the error are kept.
+ * done:            1 once the chunk has been converted, 0 once it has been
+ *                  written and the slot can be reused.
+ */
+typedef struct {
+    const char* start;
+    const char* end;
+    PackedPosition* positions;
+    uint64* keys;
+    int numPositions;
+    int capacity;
+    int numGames;
+    int numErrors;
+    int done;
+} ConvertChunk;
+
+static PgnFile input;
+static int minPly;
+
+static int numThreads;
+static int numSlots;
+static thrd_t threads[MAX_THREADS];
+static Board boards[MAX_THREADS];
+static ConvertChunk slots[MAX_THREADS * SLOTS_PER_THREAD];
+
+// Shared between the threads, guarded by 'lock'.
+static mtx_t lock;
+static cnd_t chunkDone;
+static cnd_t chunkWritten;
+static const char* nextStart;
+static int nextChunk;
+static int chunksWritten;
+
+/*
+ * Find the start of the first game that begins after c: a line starting with
+ * a tag pair ("[Event ...") that comes after a line of moves. Comments can
+ * contain brackets, so the tag name must start with a letter (which rules
+ * out comment commands such as "[%clk 0:03:00]"). The partial line at c is
+ * skipped. Return 'end' if there is no game after c.
+ */
+static const char* findGameStart(const char* c, const char* end) {
+    if (c >= end) {
+        return end;
+    }
+    const char* line = (const char*) memchr(c, '\n', end - c);
+    // if c is in the tag pairs of a game, the game starts before c
+    int afterTags = 1;
+    while (line != NULL && ++line < end) {
+        if (*line == '[' && line + 1 < end
+            && ((line[1] >= 'A' && line[1] <= 'Z')
+            || (line[1] >= 'a' && line[1] <= 'z'))) {
+            if (!afterTags) {
+                return line;
+            }
+            afterTags = 1;
+        } else if (*line != '\n' && *line != '\r') {
+            afterTags = 0;
+        }
+        line = (const char*) memchr(line, '\n', end - line);
+    }
+    return end;
+}
+
+/*
+ * Make room for one more position in the chunk's buffers. Return 1 if there
+ * is room, 0 if there is not enough memory.
+ */
+static int reservePosition(ConvertChunk* chunk) {
+    if (chunk->numPositions < chunk->capacity) {
+        return 1;
+    }
+    int capacity = chunk->capacity ? chunk->capacity * 2 : INITIAL_CAPACITY;
+    PackedPosition* positions = (PackedPosition*) realloc(chunk->positions,
+        sizeof(PackedPosition) * capacity);
+    if (positions == NULL) {
+        return 0;
+    }
+    chunk->positions = positions;
+    uint64* keys = (uint64*) realloc(chunk->keys, sizeof(uint64) * capacity);
+    if (keys == NULL) {
+        return 0;
+    }
+    chunk->keys = keys;
+    chunk->capacity = capacity;
+    return 1;
+}
+
+/*
+ * Replay every game in the chunk on the board and store the positions that
+ * pass the filters. Return 1 if the chunk was converted, 0 if there was not
+ * enough memory.
+ */
+static int convertChunk(Board* board, ConvertChunk* chunk) {
+    PgnFile file = input;
+    file.position = chunk->start;
+    file.end = chunk->end;
+    file.inGame = 0;
+    PgnGame game;
+    chunk->numPositions = chunk->numGames = chunk->numErrors = 0;
+    while (readPgnHeaders(&file, &game)) {
+        ++chunk->numGames;
+        // a FEN tag can set up more pieces than a PackedPosition holds, and a
+        // game never gains pieces, so such games are skipped as a whole
+        if (!startPgnGame(board, &game)
+            || countBits(board->colorBitboards[BOTH_COLORS]) > 32) {
+            ++chunk->numErrors;
+            continue;
+        }
+        for (int ply = 0; ; ++ply) {
+            int move = readPgnMove(&file, board);
+            if (move <= 0) {
+                chunk->numErrors += move < 0;
+                break;
+            }
+            int side = board->sideToMove;
+            int keep = ply >= minPly
+                && !squareAttacked(board,
+                    board->pieceBitboards[pieces[side][KING]], side ^ 1);
+            if (keep) {
+                if (!reservePosition(chunk)) {
+                    return 0;
+                }
+                PackedPosition* packed = &chunk->positions[chunk->numPositions];
+                packPosition(board, packed);
+                packed->bestMove = packMove(move);
+                packed->result = (unsigned char) game.result;
+                chunk->keys[chunk->numPositions++] = board->positionKey;
+            }
+            if (!makeMove(board, move)) {
+                // the move leaves the king in check, so it was not this move
+                chunk->numPositions -= keep;
+                ++chunk->numErrors;
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * Thread function that takes the next chunk of the file, converts it, and
+ * marks it as done until the whole file has been taken.
+ */
+static int convertThread(void* args) {
+    Board* board = (Board*) args;
+    int result = 0;
+    mtx_lock(&lock);
+    for (;;) {
+        while (nextStart < input.end && nextChunk >= chunksWritten + numSlots) {
+            cnd_wait(&chunkWritten, &lock);
+        }
+        if (nextStart >= input.end) {
+            break;
+        }
+        ConvertChunk* chunk = &slots[nextChunk++ % numSlots];
+        chunk->start = nextStart;
+        chunk->end = findGameStart(input.end - nextStart > CHUNK_SIZE
+            ? nextStart + CHUNK_SIZE : input.end, input.end);
+        nextStart = chunk->end;
+        mtx_unlock(&lock);
+
+        int converted = convertChunk(board, chunk);
+
+        mtx_lock(&lock);
+        if (!converted) {
+            puts("Error: convertThread: Not enough memory for a chunk.");
+            chunk->numPositions = 0;
+            result = 1;
+        }
+        chunk->done = 1;
+        cnd_broadcast(&chunkDone);
+    }
+    mtx_unlock(&lock);
+    return result;
+}
+
+/*
+ * Write the chunks to the output file in order as they are converted,
+ * skipping the positions whose keys are already in the dedup table. Return 1
+ * if everything was written, 0 otherwise.
+ */
+static int writeChunks(FILE* output, uint64* seen, uint64* numGames,
+    uint64* numErrors, uint64* numPositions, uint64* numDuplicates) {
+    const uint64 mask = (1ULL << DEDUP_BITS) - 1;
+    for (int index = 0; ; ++index) {
+        ConvertChunk* chunk = &slots[index % numSlots];
+        mtx_lock(&lock);
+        while (!chunk->done && (index < nextChunk || nextStart < input.end)) {
+            cnd_wait(&chunkDone, &lock);
+        }
+        mtx_unlock(&lock);
+        if (!chunk->done) {
+            return 1;
+        }
+
+        int count = 0;
+        for (int i = 0; i < chunk->numPositions; ++i) {
+            uint64 key = chunk->keys[i];
+            if (seen[key & mask] == key) {
+                continue;
+            }
+            seen[key & mask] = key;
+            chunk->positions[count++] = chunk->positions[i];
+        }
+        *numGames += chunk->numGames;
+        *numErrors += chunk->numErrors;
+        *numPositions += count;
+        *numDuplicates += chunk->numPositions - count;
+        if (fwrite(chunk->positions, sizeof(PackedPosition), count, output)
+            != (size_t) count) {
+            puts("Error: writeChunks: Could not write to the output file.");
+            return 0;
+        }
+
+        mtx_lock(&lock);
+        chunk->done = 0;
+        ++chunksWritten;
+        cnd_broadcast(&chunkWritten);
+        mtx_unlock(&lock);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        puts("Usage: convert <games.pgn> <output.bin> [threads] [min ply]");
+        return -1;
+    }
+    numThreads = argc > 3 ? atoi(argv[3]) : countProcessors();
+    numThreads = numThreads < 1 ? 1 : numThreads;
+    numThreads = numThreads > MAX_THREADS ? MAX_THREADS : numThreads;
+    numSlots = numThreads * SLOTS_PER_THREAD;
+    minPly = argc > 4 ? atoi(argv[4]) : DEFAULT_MIN_PLY;
+    initializeAll();
+
+    if (!openPgnFile(&input, argv[1])) {
+        return -1;
+    }
+    FILE* output = fopen(argv[2], "wb");
+    uint64* seen = (uint64*) calloc(1ULL << DEDUP_BITS, sizeof(uint64));
+    if (output == NULL || seen == NULL) {
+        puts(output == NULL ? "Error: main: Could not open the output file."
+            : "Error: main: Not enough memory for the dedup table.");
+        if (output != NULL) {
+            fclose(output);
+        }
+        closePgnFile(&input);
+        return -1;
+    }
+    nextStart = input.position;
+    mtx_init(&lock, mtx_plain);
+    cnd_init(&chunkDone);
+    cnd_init(&chunkWritten);
+
+    uint64 startTime = getTime();
+    int started = 0;
+    for (; started < numThreads; ++started) {
+        if (thrd_create(&threads[started], convertThread, &boards[started])
+            != thrd_success) {
+            printf("Error: main: could not create thread %d\n", started);
+            break;
+        }
+    }
+    uint64 numGames = 0, numErrors = 0, numPositions = 0, numDuplicates = 0;
+    int ok = 0;
+    if (started > 0) {
+        ok = writeChunks(output, seen, &numGames, &numErrors, &numPositions,
+            &numDuplicates);
+    }
+    if (!ok) {
+        // stop the threads from taking more chunks and free every slot
+        mtx_lock(&lock);
+        nextStart = input.end;
+        chunksWritten = nextChunk;
+        cnd_broadcast(&chunkWritten);
+        mtx_unlock(&lock);
+    }
+    for (int i = 0; i < started; ++i) {
+        int result;
+        thrd_join(threads[i], &result);
+        ok = ok && result == 0;
+    }
+    uint64 time = getTime() - startTime;
+    time = time > 0 ? time : 1;
+
+    printf("Converted %llu games (%llu with errors) in %llu ms with %d "
+        "threads\n", numGames, numErrors, time, numThreads);
+    printf("Wrote %llu positions, skipped %llu duplicates\n", numPositions,
+        numDuplicates);
+    printf("Average: %llu MB/s, %llu positions/s\n",
+        input.size * 1000 / time >> 20, numPositions * 1000 / time);
+
+    for (int i = 0; i < numSlots; ++i) {
+        free(slots[i].positions);
+        free(slots[i].keys);
+    }
+    free(seen);
+    cnd_destroy(&chunkWritten);
+    cnd_destroy(&chunkDone);
+    mtx_destroy(&lock);
+    closePgnFile(&input);
+    if (fclose(output) != 0) {
+        ok = 0;
+    }
+    return ok ? 0 : -1;
+}
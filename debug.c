@@ -1,6 +1,6 @@
 #include "defs.h"
 
-#include <string.h>  // memcpy
+#include <string.h>  // memcpy, memcmp
 #include <stdio.h>   // printf, puts, putchar
 
 /* 
@@ -51,6 +51,8 @@ static uint64 getColorBitboard(const Board* board, int color) {
 int checkBoard(const Board* board) {
     assert(board != NULL);
     assert(board->positionKey == generatePositionKey(board));
+    assert(board->pawnKey == generatePawnKey(board));
+    assert(board->materialKey == generateMaterialKey(board));
     assert(board->sideToMove == WHITE || board->sideToMove == BLACK);
     assert(board->colorBitboards[WHITE] == getColorBitboard(board, WHITE));
     assert(board->colorBitboards[BLACK] == getColorBitboard(board, BLACK));
@@ -60,19 +62,34 @@ int checkBoard(const Board* board) {
     assert(board->searchPly >= 0 && board->searchPly <= MAX_GAME_MOVES * 2);
     // Loop through each piece in the board and count the number of each piece
     // type. Make sure the numbers of each piece type are valid. Also verify
-    // that board->material[] is correct.
+    // that board->material[], board->pieceSquare[], and board->phase are
+    // correct.
     int pieceCounts[NUM_PIECE_TYPES] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
     int materialCounts[2] = { 0, 0 };
+    int pieceSquareCounts[2][2] = { { 0, 0 }, { 0, 0 } };
+    int phaseCount = 0;
     for (int square = 0; square < 64; ++square) {
         if (board->pieces[square] != NO_PIECE) {
             int piece = board->pieces[square];
             materialCounts[pieceColor[piece]] += material[piece];
+            pieceSquareCounts[MIDDLEGAME][pieceColor[piece]] +=
+                pieceValue[MIDDLEGAME][piece][square];
+            pieceSquareCounts[ENDGAME][pieceColor[piece]] +=
+                pieceValue[ENDGAME][piece][square];
+            phaseCount += phaseWeight[piece];
             assert(piece >= 0 && piece < NUM_PIECE_TYPES);
             ++pieceCounts[piece];
         }
     }
     assert(materialCounts[WHITE] == board->material[WHITE]);
     assert(materialCounts[BLACK] == board->material[BLACK]);
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        assert(pieceSquareCounts[phase][WHITE] ==
+            board->pieceSquare[phase][WHITE]);
+        assert(pieceSquareCounts[phase][BLACK] ==
+            board->pieceSquare[phase][BLACK]);
+    }
+    assert(phaseCount == board->phase);
     assert(pieceCounts[WHITE_KING] == 1 && pieceCounts[BLACK_KING] == 1);
     assert(pieceCounts[WHITE_PAWN] <= 8 && pieceCounts[BLACK_PAWN] <= 8);
     assert(pieceCounts[WHITE_KNIGHT] + pieceCounts[WHITE_PAWN] <= 10);
@@ -125,6 +142,13 @@ int checkBoard(const Board* board) {
     }
     // make sure that only the last 4 bits of the castlePerms int are used
     assert(!(board->castlePerms & 0xFFFFFFF0));
+    // make sure the NNUE accumulator matches one computed from scratch
+    if (board->accumulator != NULL) {
+        assert(board->accumulator == board->accumulatorStack + board->ply);
+        Accumulator fresh;
+        refreshAccumulator(board, &fresh);
+        assert(memcmp(&fresh, board->accumulator, sizeof(Accumulator)) == 0);
+    }
     return 1;
 }
 
@@ -200,34 +224,6 @@ int validMove(int move) {
     return 1;
 }
 
-/*
- * Print an 8x8 grid of pieces to the console. If there is not a piece on a
- * square, print '-'. The board will be printed from white's perspective (8th
- * rank on top, 1st rank on the bottom, A file on the left, and H file on the
- * right).
- * 
- * board:       The board whose pieces will be printed to the console. Passed
- *              in as a pointer which must not be NULL.
- */
-void printPieces(const Board* board) {
-    assert(board != NULL);
-    const char* pieceChar = "PNBRQKpnbrqk";
-    int rank = 8;
-    for (int square = 56; square >= 0; square -= 8) {
-        printf("%d  ", rank--);
-        for (int fileIndex = 0; fileIndex < 8; ++fileIndex) {
-            int piece = board->pieces[square + fileIndex];
-            printf("%c ", piece == NO_PIECE ? '-' : pieceChar[piece]);
-        }
-        putchar('\n');
-    }
-    printf("\n  ");
-    for (int i = 0; i < 8; ++i) {
-        printf(" %c", (char) ('a' + i));
-    }
-    putchar('\n');
-}
-
 /*
  * Print the given bitboard to the console. Print an 'X' to mark a piece and
  * a '-' to mark an empty space. We want to print the board so that a1 is in
@@ -303,24 +299,3 @@ void printBoard(const Board* board) {
     puts("============================================");
 }
 
-/*
- * Given a move on the chessboard, fill the 'moveString' parameter with the
- * text version of the move. For example, if the 'from' square is 8 (a2) and
- * the 'to' square is 24 (a4), the moveString will be "a2a4". Also, if the move
- * results in a promotion, append the letter of the promoted piece to the move
- * string. For example: "a7a8Q".
- * 
- * move:        A 32-bit integer with all the information of the move.
- * moveString:  A string where the text-version of the move will be placed. The
- *              string must be at least 6 chars long.
- */
-void getMoveString(int move, char* moveString) {
-    assert(validMove(move));
-    const char* pieceChar = "PNBRQKpnbrqk\0\0\0\0\0";
-    moveString[0] = (move & 0x3F) % 8 + 'a';
-    moveString[1] = (move & 0x3F) / 8 + '1';
-    moveString[2] = ((move >> 6) & 0x3F) % 8 + 'a';
-    moveString[3] = ((move >> 6) & 0x3F) / 8 + '1';
-    moveString[4] = pieceChar[(move >> 16) & 0xF];
-    moveString[5] = 0;
-}
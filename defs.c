@@ -1,9 +1,11 @@
 #include "defs.h"
 
 #if defined(OS_WINDOWS)
-    #include <windows.h>   // GetTickCount
+    #include <windows.h>   // GetTickCount, GetSystemInfo, QueryPerformanceCounter
 #elif defined(OS_LINUX)
     #include <sys/time.h>  // struct timeval, gettimeofday
+    #include <time.h>      // struct timespec, clock_gettime
+    #include <unistd.h>    // sysconf
 #endif
 
 const int pieceColor[NUM_PIECE_TYPES] = {
@@ -18,14 +20,25 @@ const int pieces[BOTH_COLORS][NUM_PIECE_TYPES] = {
 
 const int material[NUM_PIECE_TYPES] = { 1, 3, 3, 5, 9, 0, 1, 3, 3, 5, 9, 0 };
 
+const int phaseWeight[NUM_PIECE_TYPES] = { 0, 1, 1, 2, 4, 0, 0, 1, 1, 2, 4, 0 };
+
+// the game phase (0 to MAX_PHASE) scaled to 0 to 1 << PHASE_SHIFT, so the
+// middlegame and endgame scores can be blended with a shift
+const int phaseScale[MAX_PHASE + 1] = {
+    0, 11, 21, 32, 43, 53, 64, 75, 85, 96, 107, 117, 128,
+    139, 149, 160, 171, 181, 192, 203, 213, 224, 235, 245, 256,
+};
+
 /*
  * Call this function once at the start of the program to initialize the bishop
- * and rook attack tables and to initialize the hash keys.
+ * and rook attack tables, the hash keys, and the evaluation tables.
  */
 void initializeAll() {
     initBishopAttackTable();
     initRookAttackTable();
     initHashKeys();
+    initEvaluation();
+    initBatchEvaluation();
 }
 
 /*
@@ -104,6 +117,31 @@ int countBits(uint64 bitboard) {
 #endif
 }
 
+/*
+ * Flip the given bitboard vertically, so that rank 1 becomes rank 8, rank 2
+ * becomes rank 7, etc. Since each rank is one byte of the bitboard, this is
+ * the same as reversing the order of the bytes. Ex: flipBitboard(0xFF) =
+ * 0xFF00000000000000. This lets code written from white's perspective be
+ * reused for black.
+ *
+ * bitboard:   The 64-bit number to be flipped.
+ *
+ * return:     The flipped bitboard.
+ */
+uint64 flipBitboard(uint64 bitboard) {
+#if defined(COMPILER_GCC)
+    return __builtin_bswap64(bitboard);
+#elif defined(COMPILER_MSVS)
+    return _byteswap_uint64(bitboard);
+#else
+    bitboard = ((bitboard >> 8) & 0x00FF00FF00FF00FF)
+        | ((bitboard & 0x00FF00FF00FF00FF) << 8);
+    bitboard = ((bitboard >> 16) & 0x0000FFFF0000FFFF)
+        | ((bitboard & 0x0000FFFF0000FFFF) << 16);
+    return (bitboard >> 32) | (bitboard << 32);
+#endif
+}
+
 /*
  * Return a time value in milliseconds. A time value on its own is meaningless.
  * This function is meant to be called twice so that an elapsed time in
@@ -122,3 +160,50 @@ uint64 getTime() {
     return (uint64) (t.tv_sec * 1000ULL + t.tv_usec / 1000ULL);
 #endif
 }
+
+/*
+ * Return a time value in nanoseconds from a monotonic clock, for timing code
+ * that runs too quickly for getTime() (Ex: the microbenchmarks in
+ * bench_micro.c). Like getTime(), only the difference between two values is
+ * meaningful. Windows uses QueryPerformanceCounter() and linux uses
+ * clock_gettime().
+ *
+ * return: a time value in nanoseconds
+ */
+uint64 getTimeNs() {
+#if defined(OS_WINDOWS)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    uint64 ticks = (uint64) counter.QuadPart;
+    uint64 perSecond = (uint64) frequency.QuadPart;
+    // split the conversion so that ticks * 10^9 cannot overflow
+    return ticks / perSecond * 1000000000ULL
+        + ticks % perSecond * 1000000000ULL / perSecond;
+#elif defined(OS_LINUX)
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64) t.tv_sec * 1000000000ULL + (uint64) t.tv_nsec;
+#endif
+}
+
+/*
+ * Return the number of logical processors of the machine. Used as the number
+ * of threads for work that is split between threads. This is OS specific:
+ * Windows uses GetSystemInfo() and linux uses sysconf().
+ *
+ * return: the number of logical processors (at least 1)
+ */
+int countProcessors() {
+#if defined(OS_WINDOWS)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int) info.dwNumberOfProcessors;
+#elif defined(OS_LINUX)
+    int count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
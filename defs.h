@@ -38,7 +38,11 @@ typedef unsigned long long uint64;
 #define MAX_GAME_MOVES 512
 #define NUM_PIECE_TYPES 12
 #define MAX_SEARCH_DEPTH 64
+#define MAX_PHASE 24
+#define PHASE_SHIFT 8
+#define NNUE_HIDDEN 256
 #define NO_PIECE -1
+#define BUCKET_ENTRIES 8
 
 #define MOVE_FLAGS                 0x1F00000
 #define CAPTURE_FLAG               0x0100000
@@ -53,6 +57,11 @@ typedef unsigned long long uint64;
 #define CASTLE_BK 0x4
 #define CASTLE_BQ 0x8
 
+#define OPPOSITE_BISHOPS 0x1
+
+#define FILE_A 0x0101010101010101ULL
+#define FILE_H 0x8080808080808080ULL
+
 enum Piece {
     WHITE_PAWN, WHITE_KNIGHT, WHITE_BISHOP, WHITE_ROOK, WHITE_QUEEN, WHITE_KING,
     BLACK_PAWN, BLACK_KNIGHT, BLACK_BISHOP, BLACK_ROOK, BLACK_QUEEN, BLACK_KING,
@@ -74,46 +83,199 @@ enum Color {
     WHITE, BLACK, BOTH_COLORS,
 };
 
+enum GamePhase {
+    MIDDLEGAME, ENDGAME,
+};
+
 extern const int pieceColor[NUM_PIECE_TYPES];
 extern const int pieces[BOTH_COLORS][NUM_PIECE_TYPES];
 extern const int material[NUM_PIECE_TYPES];
+extern const int phaseWeight[NUM_PIECE_TYPES];
+extern const int phaseScale[MAX_PHASE + 1];
+extern int pieceValue[2][NUM_PIECE_TYPES][64];
 
 void initializeAll();
 int getLSB(uint64 bitboard);
 int getMSB(uint64 bitboard);
 int countBits(uint64 bitboard);
+uint64 flipBitboard(uint64 bitboard);
 uint64 getTime();
+uint64 getTimeNs();
+int countProcessors();
 
 /*
- * A single entry in a HashTable. Each entry stores a move and a position key.
- * When the search algorithm finds a good move in a certain position, it will
- * store the move and the board's position key in the hash table. We store the 
- * position key as well because hash collisions are possible and when we go to 
- * retrieve the move, we want to be sure that the move is for the correct board
- * (The move could have been overridden by another board with the same hash).
- * 
- * positionKey:     The position key for the board whose move we are storing.
- * move:            The move to be stored.
+ * A single entry in a HashTable. Each entry stores a move and part of a
+ * position key. When the search algorithm finds a good move in a certain
+ * position, it will store the move and the board's position key in the hash
+ * table. Part of the position key is stored as well because hash collisions
+ * are possible and when we go to retrieve the move, we want to be sure that
+ * the move is for the correct board (The move could have been overridden by
+ * another board with the same hash). The lower bits of the position key
+ * choose the bucket, so only the upper 16 bits need to be stored.
+ *
+ * The whole entry is packed into one 64-bit integer which is always read and
+ * written with a single 64-bit load or store. That way several threads can
+ * share a table without locks: a thread can never see the move of one entry
+ * together with the key of another (a torn entry), since both are in the
+ * same word.
+ *
+ * bits 0-31:       The move to be stored, or 0 if the entry is empty.
+ * bits 32-47:      The upper 16 bits of the position key for the board whose
+ *                  move we are storing.
+ * bits 48-55:      The depth of the search that found the move. Deeper
+ *                  results are more valuable and are kept longer.
+ * bits 56-63:      The table's generation when the move was stored. Entries
+ *                  from older searches are replaced first.
+ */
+typedef uint64 HashEntry;
+
+/*
+ * A group of BUCKET_ENTRIES hash entries that fills exactly one 64-byte cache
+ * line. A position can be stored in any entry of its bucket, so a probe
+ * touches a single cache line and a new entry does not have to overwrite a
+ * more valuable one.
  */
 typedef struct {
-    uint64 positionKey;
-    int move;
-} HashEntry;
+    HashEntry entries[BUCKET_ENTRIES];
+} HashBucket;
 
 /*
  * A hash table used to store the best moves found by the search algorithm. The
  * table uses dynamically allocated data from the heap. Each board has a single
- * hash table (named pvTable) to store its best moves.
+ * hash table (named pvTable) to store its best moves. A copy of a board
+ * (Ex: one for each search thread) shares the table's memory with the
+ * original, which is safe since every HashEntry is read and written as a
+ * single 64-bit word.
  * 
- * table:           The table of hashEntries.
- * numEntries:      The number of hashEntries in the table. This value is set
- *                  when the table is allocated from the heap.
+ * table:           The table of HashBuckets. Allocated with huge pages when
+ *                  possible (see hashtable.c).
+ * mapping:         The start of the memory-mapped file or shared memory that
+ *                  holds the table (see mapHashTable() and
+ *                  shareHashTable()), or NULL if the table is private.
+ * numBuckets:      The number of HashBuckets in the table. Always a power of
+ *                  2, so a bucket can be found by masking the position key.
+ *                  This value is set when the table is allocated.
+ * generation:      Incremented at the start of every search by
+ *                  ageHashTable(). Used to tell old entries from new ones.
  */
 typedef struct {
-    HashEntry* table;
-    int numEntries;
+    HashBucket* table;
+    void* mapping;
+    uint64 numBuckets;
+    unsigned char generation;
 } HashTable;
 
+/*
+ * A single entry in a PawnTable. Each entry stores the evaluation of a pawn
+ * structure along with bitboards that describe it, so that the pawn structure
+ * only has to be evaluated the first time it is seen. Entries are 64 bytes so
+ * that each one fits in a single cache line.
+ *
+ * pawnKey:         The pawn key for the pawn structure whose terms we are
+ *                  storing (see Board.pawnKey).
+ * score:           The middlegame and endgame scores of the pawn structure
+ *                  from white's perspective (doubled, isolated, backward,
+ *                  and passed pawns). Indexed by phase.
+ * passed:          A bitboard of the passed pawns of each side.
+ * attackSpan:      A bitboard of every square that the pawns of each side
+ *                  attack or could attack after advancing.
+ */
+typedef struct {
+    uint64 pawnKey;
+    int score[2];
+    uint64 passed[2];
+    uint64 attackSpan[2];
+    uint64 padding[2];
+} PawnEntry;
+
+/*
+ * A hash table used to store pawn structure evaluations. The table uses
+ * dynamically allocated data from the heap. Each board has a single pawn
+ * table (named pawnTable).
+ *
+ * table:           The table of PawnEntries.
+ * numEntries:      The number of PawnEntries in the table. Always a power
+ *                  of 2. This value is set when the table is allocated.
+ */
+typedef struct {
+    PawnEntry* table;
+    uint64 numEntries;
+} PawnTable;
+
+/*
+ * A cache of static evaluations used by the search. Each entry is a single
+ * 64-bit integer holding the upper 48 bits of a position key and a 16-bit
+ * evaluation in the lower 16 bits. Since an entry is read and written with a
+ * single 64-bit load or store, an entry can never be half written, so the
+ * cache needs no locks.
+ *
+ * table:           The table of entries, aligned to a 64 byte cache line.
+ * memory:          The block of memory returned by malloc() that table
+ *                  points into. Passed to free().
+ * numEntries:      The number of entries in the table. Always a power of 2.
+ */
+typedef struct {
+    uint64* table;
+    void* memory;
+    uint64 numEntries;
+} EvalCache;
+
+/*
+ * The first layer of the NNUE evaluator (see nnue.c) computed from white's
+ * perspective (values[WHITE]) and from black's perspective (values[BLACK]).
+ * Each board has a stack of accumulators, one for each ply, which is pushed
+ * in makeMove() and popped in undoMove().
+ */
+typedef struct {
+    short values[2][NNUE_HIDDEN];
+} Accumulator;
+
+struct Board;
+
+/*
+ * A single entry in a MaterialTable. Each entry stores information that
+ * depends only on how many pieces of each type are on the board, so that it
+ * only has to be worked out the first time a material key is seen. Entries
+ * are padded to 32 bytes so that the number of entries in a table is a power
+ * of 2.
+ *
+ * materialKey:     The material key (see Board.materialKey) of the entry.
+ * evaluate:        A specialized evaluation function for a known endgame
+ *                  (Ex: king and rook vs king), or NULL if there is none.
+ *                  Returns the evaluation from strongSide's perspective.
+ * imbalance:       The material imbalance bonus from white's perspective
+ *                  (Ex: the bishop pair), in 100ths of a pawn.
+ * scale:           For each side, how much the evaluation should be scaled
+ *                  down by when that side is ahead, out of 64. 0 means the
+ *                  side can't win (Ex: a lone knight).
+ * strongSide:      The side with the extra material if evaluate is not NULL.
+ * flags:           OPPOSITE_BISHOPS if each side has only a bishop and
+ *                  pawns, so the bishops might be on opposite colors.
+ */
+typedef struct {
+    uint64 materialKey;
+    int (*evaluate)(const struct Board* board, int strongSide);
+    short imbalance;
+    unsigned char scale[2];
+    unsigned char strongSide;
+    unsigned char flags;
+    unsigned char padding[8];
+} MaterialEntry;
+
+/*
+ * A hash table used to store material table entries. The table uses
+ * dynamically allocated data from the heap. Each board has a single material
+ * table (named materialTable).
+ *
+ * table:           The table of MaterialEntries.
+ * numEntries:      The number of MaterialEntries in the table. Always a
+ *                  power of 2. This value is set when the table is allocated.
+ */
+typedef struct {
+    MaterialEntry* table;
+    uint64 numEntries;
+} MaterialTable;
+
 /*
  * A structure to hold information about moves that were already made. The
  * board struct stores each move that was made to get to its current position
@@ -160,9 +322,28 @@ typedef struct {
  *                    piece bitboards.
  * positionKey:       A 64-bit integer that is unique to the current position.
  *                    This value is used to check for 3-fold repetitions.
+ * pawnKey:           A 64-bit integer that is unique to the current pawn
+ *                    structure. Made from the same piece hash keys as the
+ *                    positionKey, but only for pawns. Used as the key into
+ *                    the pawnTable.
+ * materialKey:       The number of pieces of each type on the board, with 4
+ *                    bits per piece type: bits 0-3 hold the number of white
+ *                    pawns, bits 4-7 the number of white knights, etc. Used
+ *                    as the key into the materialTable.
  * material:          Two integers holding the overall material for each side.
  *                    (Q=9, R=5, B=3, N=3, P=1). First set in setBoardToFen()
  *                    and updated incrementally as moves are made and unmade.
+ * pieceSquare:       The sum of pieceValue[phase][piece][sq] (see
+ *                    evaluate.c) over every piece of each side, for both the
+ *                    middlegame and the endgame. Indexed [phase][color].
+ *                    Updated incrementally along with material so that the
+ *                    static evaluation does not have to loop over the
+ *                    bitboards.
+ * phase:             The game phase: the sum of phaseWeight[] over every
+ *                    piece on the board (N=1, B=1, R=2, Q=4). MAX_PHASE in
+ *                    the starting position and 0 when only kings and pawns
+ *                    are left. Used to blend the middlegame and endgame
+ *                    evaluations. Updated incrementally along with material.
  * sideToMove:        An integer that is either 0 (white) or 1 (black) denoting
  *                    whose turn it is in the current position.
  * ply:               An integer holding the number of half moves made to get
@@ -180,16 +361,33 @@ typedef struct {
  *                    the moves made to get to the board's current position.
  * pvTable:           Principle Variation table. A hash table used to store the
  *                    best moves found by the alpha-beta algorithm, allowing us
- *                    to speed up our search.
+ *                    to speed up our search. This and the other tables below
+ *                    are allocated by initBoardTables() and are kept when the
+ *                    board is set to a new position.
+ * pawnTable:         A hash table used to store pawn structure evaluations,
+ *                    keyed by the pawnKey.
+ * materialTable:     A hash table used to store material imbalances, draw
+ *                    scaling, and known endgames, keyed by the materialKey.
+ * evalCache:         A cache of static evaluations keyed by the positionKey.
+ * accumulator:       The NNUE accumulator for the current position (the top
+ *                    of the accumulatorStack), or NULL if no network is
+ *                    loaded. Updated incrementally as pieces are added,
+ *                    removed, and moved.
+ * accumulatorStack:  A dynamically allocated array of accumulators, one for
+ *                    each ply, or NULL if no network is loaded.
  * pvArray:           An array of moves (ints) storing the principal variation
  *                    (best / main line) of the current position.
  */
-typedef struct {
+typedef struct Board {
     uint64 pieceBitboards[NUM_PIECE_TYPES];
     uint64 colorBitboards[3];
     signed char pieces[64];
     uint64 positionKey;
+    uint64 pawnKey;
+    uint64 materialKey;
     int material[2];
+    int pieceSquare[2][2];
+    int phase;
     int sideToMove;
     int ply;
     int searchPly;
@@ -198,6 +396,11 @@ typedef struct {
     uint64 enPassantSquare;
     PreviousMove history[MAX_GAME_MOVES];
     HashTable pvTable;
+    PawnTable pawnTable;
+    MaterialTable materialTable;
+    EvalCache evalCache;
+    Accumulator* accumulator;
+    Accumulator* accumulatorStack;
     int pvArray[MAX_SEARCH_DEPTH];
 
     // any time a move beats alpha, for that piece type and the to square, we will increment the array by 1. 
@@ -208,6 +411,197 @@ typedef struct {
 
 } Board;
 
+/*
+ * A batch of positions for evaluateBatch() (see batcheval.c), stored as a
+ * structure of arrays: pieceBitboards[piece][i] is the bitboard of the given
+ * piece type in position i. Keeping each piece type's bitboards next to each
+ * other lets the evaluation load the same bitboard of several positions with
+ * a single vector load. The arrays are owned by the caller.
+ *
+ * pieceBitboards:    For each piece type, an array of numPositions
+ *                    bitboards.
+ * sideToMove:        An array of numPositions sides to move (WHITE or
+ *                    BLACK).
+ * numPositions:      The number of positions in the batch.
+ */
+typedef struct {
+    uint64* pieceBitboards[NUM_PIECE_TYPES];
+    int* sideToMove;
+    int numPositions;
+} PositionBatch;
+
+/*
+ * A chess position packed into 32 bytes, for datasets of millions of
+ * positions (see packPosition() in board.c). Files of packed positions are
+ * arrays of this struct in the machine's byte order (little-endian on x86).
+ *
+ * occupancy:         A bitboard of the occupied squares.
+ * pieces:            The piece on each occupied square, 4 bits each, in the
+ *                    order of the squares in occupancy (lowest bit first).
+ *                    The first piece is in the low 4 bits of pieces[0].
+ * score:             An evaluation of the position in 100ths of a pawn from
+ *                    the perspective of the side to move, or PACKED_NO_SCORE.
+ * bestMove:          The best move packed by packMove(), or 0.
+ * flags:             The side to move in bit 0 and the castlePerms in bits
+ *                    1 to 4.
+ * enPassantSquare:   The en passant square, or 0 if there isn't one (A1 can
+ *                    never be an en passant square).
+ * fiftyMoveCount:    The number of half moves since the last capture or
+ *                    pawn move.
+ * result:            The result of the game in half points for white (0 =
+ *                    black won, 1 = draw, 2 = white won), or PACKED_NO_RESULT.
+ */
+#define PACKED_NO_SCORE -32768
+#define PACKED_NO_RESULT 0xFF
+typedef struct {
+    uint64 occupancy;
+    unsigned char pieces[16];
+    short score;
+    unsigned short bestMove;
+    unsigned char flags;
+    unsigned char enPassantSquare;
+    unsigned char fiftyMoveCount;
+    unsigned char result;
+} PackedPosition;
+
+/*
+ * A PGN file that is mapped into memory and read one game at a time (see
+ * pgn.c). A PgnFile can also read just a part of the file (Ex: one chunk per
+ * thread) by setting 'position' and 'end' to the start and end of the part.
+ *
+ * data:        The contents of the file, or NULL if the file is empty.
+ * size:        The size of the file in bytes.
+ * position:    The next character to read.
+ * end:         The end of the part of the file being read.
+ * inGame:      1 while the moves of a game are being read, 0 otherwise.
+ */
+typedef struct {
+    const char* data;
+    uint64 size;
+    const char* position;
+    const char* end;
+    int inGame;
+} PgnFile;
+
+/*
+ * The tag pairs of the PGN game being read.
+ *
+ * tags:         The tag pairs section of the game in the file. Search it
+ *               with findPgnTag().
+ * tagsLength:   The length of the tag pairs section.
+ * fen:          A NUL-terminated copy of the FEN tag, or an empty string if
+ *               the game starts from the starting position.
+ * result:       The result of the game in half points for white (0 = black
+ *               won, 1 = draw, 2 = white won), or PACKED_NO_RESULT.
+ */
+#define MAX_FEN_LENGTH 128
+typedef struct {
+    const char* tags;
+    int tagsLength;
+    char fen[MAX_FEN_LENGTH];
+    int result;
+} PgnGame;
+
+/*
+ * A read-only EPD (or FEN) file that is mapped into memory and split into
+ * lines as it is read (see epd.c). Lines point straight into the mapping, so
+ * reading a file copies nothing.
+ *
+ * data:        The contents of the file, or NULL if the file is empty.
+ * size:        The size of the file in bytes.
+ * position:    The offset of the next line in data.
+ * lastLine:    A NUL-terminated copy of the last line if the file does not
+ *              end with a newline, or NULL.
+ */
+typedef struct {
+    const char* data;
+    uint64 size;
+    uint64 position;
+    char* lastLine;
+} EpdFile;
+
+/*
+ * Hardware performance counters that count events while a part of the
+ * program runs (see perfcounters.c).
+ *
+ * fds:         The file descriptor of each counter, or -1 if the counter
+ *              could not be opened.
+ * values:      The value of each counter, added up over every time the
+ *              counters were started and stopped.
+ */
+enum PerfCounter {
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_L1D_MISSES,
+    PERF_LLC_MISSES, PERF_DTLB_MISSES, NUM_PERF_COUNTERS
+};
+typedef struct {
+    int fds[NUM_PERF_COUNTERS];
+    uint64 values[NUM_PERF_COUNTERS];
+} PerfCounters;
+
+/*
+ * The phases timed by the cycle profiler (see profiler.c). Time that is not
+ * spent in any of the other phases (Ex: the search itself) is PHASE_OTHER.
+ */
+enum ProfilePhase {
+    PHASE_OTHER, PHASE_MOVEGEN, PHASE_SORT, PHASE_MAKE_UNDO, PHASE_LEGALITY,
+    PHASE_EVAL, PHASE_HASH, NUM_PROFILE_PHASES
+};
+
+/*
+ * The profiler is only compiled in with -D PHASE_PROFILER (Ex: make release
+ * profile=-DPHASE_PROFILER). Otherwise the PROFILE_* macros do nothing.
+ *
+ * PROFILE_BEGIN(phase) starts timing a phase until PROFILE_END() in the same
+ * block, which goes back to the phase that was being timed before. It can be
+ * used once per block, and PROFILE_END() must be reached before every return.
+ * PROFILE_SWITCH(phase) moves to another phase in between. The time of a
+ * phase does not include the phases started inside of it.
+ */
+#if defined(PHASE_PROFILER)
+    #if defined(COMPILER_MSVS)
+        #include <intrin.h>      // __rdtsc
+    #else
+        #include <x86intrin.h>   // __rdtsc
+    #endif
+    #include "libs/tinycthread.h"  // _Thread_local
+
+/*
+ * The cycles of each phase counted by a thread.
+ *
+ * cycles:      The time stamp counter cycles spent in each phase.
+ * last:        The time stamp counter when the current phase was started.
+ * phase:       The phase that is being timed.
+ */
+typedef struct {
+    uint64 cycles[NUM_PROFILE_PHASES];
+    uint64 last;
+    int phase;
+} PhaseProfile;
+extern _Thread_local PhaseProfile phaseProfile;
+
+/*
+ * Add the cycles since the last switch to the current phase and start
+ * timing the given phase. Return the phase that was being timed.
+ */
+static inline int switchProfilePhase(int phase) {
+    uint64 now = __rdtsc();
+    int previous = phaseProfile.phase;
+    phaseProfile.cycles[previous] += now - phaseProfile.last;
+    phaseProfile.last = now;
+    phaseProfile.phase = phase;
+    return previous;
+}
+
+    #define PROFILE_BEGIN(phase) \
+        int profilePrevious = switchProfilePhase(phase)
+    #define PROFILE_SWITCH(phase) ((void) switchProfilePhase(phase))
+    #define PROFILE_END() ((void) switchProfilePhase(profilePrevious))
+#else
+    #define PROFILE_BEGIN(phase) ((void) 0)
+    #define PROFILE_SWITCH(phase) ((void) 0)
+    #define PROFILE_END() ((void) 0)
+#endif
+
 /******************************************************************************
 Each move in a MoveList is a 64-bit integer with the following information:
 0 0000 0000 0000 0000 0011 1111   6 bits for the 'from' square
@@ -243,6 +637,11 @@ typedef struct {
     int moves[MAX_GAME_MOVES];
 } MoveList;
 
+#define CUTOFF_HISTOGRAM_SIZE 8
+enum SearchStatsFormat {
+    STATS_NONE, STATS_JSON, STATS_UCI,
+};
+
 typedef struct {
     int startTime;
     int stopTime;
@@ -256,31 +655,77 @@ typedef struct {
     int stopped;
     float failHigh;
     float failHighFirst;
+    long long evalProbes;
+    long long evalHits;
+    long long pvHits;
+    long long pvCollisions;
+    int quiet;
+    // structured statistics of every iteration (see printIterationStats() in
+    // search.c), and how many beta cutoffs were caused by the first legal
+    // move, the second, ..., with the last bucket counting the rest
+    int statsFormat;
+    long long cutoffIndex[CUTOFF_HISTOGRAM_SIZE];
 } SearchInfo;
 
 // board.h
+int initBoardTables(Board* board);
+void freeBoardTables(Board* board);
 int setBoardToFen(Board* board, const char* fen);
+void packPosition(const Board* board, PackedPosition* packed);
+int unpackPosition(Board* board, const PackedPosition* packed);
+unsigned short packMove(int move);
+int unpackMove(const Board* board, unsigned short packedMove);
 int makeMove(Board* board, int move);
 void undoMove(Board* board);
+void printPieces(const Board* board);
 
 // hashkey.h
 void initHashKeys();
 uint64 generatePositionKey(const Board* board);
+uint64 generatePawnKey(const Board* board);
+uint64 generateMaterialKey(const Board* board);
 uint64 getSideHashKey();
 uint64 getPieceHashKey(int piece, int square);
 uint64 getEnPassantHashKey(int square);
 uint64 getCastleHashKey(int castlePerm);
+uint64 getHashKeySignature();
 
 // hashtable.h
-void initHashTable(HashTable* table);
+int setHashTableSize(uint64 megabytes);
+void setHashTableBacking(const char* path, const char* name);
+int initHashTable(HashTable* table);
+int mapHashTable(HashTable* table, const char* path);
+int shareHashTable(HashTable* table, const char* name);
 void clearHashTable(HashTable* table);
 void freeHashTable(HashTable* table);
-void storeMove(HashTable* table, int move, uint64 positionKey);
+void ageHashTable(HashTable* table);
+void storeMove(HashTable* table, int move, uint64 positionKey, int depth);
 int retrieveMove(HashTable* table, uint64 positionKey);
+void prefetchHashTable(const HashTable* table, uint64 positionKey);
+int initEvalCache(EvalCache* evalCache);
+void clearEvalCache(EvalCache* evalCache);
+void freeEvalCache(EvalCache* evalCache);
+void prefetchEvalCache(const EvalCache* evalCache, uint64 positionKey);
+int probeEvalCache(const EvalCache* evalCache, uint64 positionKey, int* eval);
+void storeEvalCache(EvalCache* evalCache, uint64 positionKey, int eval);
+
+// pawns.h
+int initPawnTable(PawnTable* pawnTable);
+void clearPawnTable(PawnTable* pawnTable);
+void freePawnTable(PawnTable* pawnTable);
+const PawnEntry* probePawnTable(const Board* board);
+
+// material.h
+int initMaterialTable(MaterialTable* materialTable);
+void freeMaterialTable(MaterialTable* materialTable);
+const MaterialEntry* probeMaterialTable(const Board* board);
+int scaleEvaluation(const Board* board, const MaterialEntry* entry, int eval);
 
 // movegen.h
 void generateAllMoves(const Board* board, MoveList* list);
 int moveExists(Board* board, int move);
+int buildMove(const Board* board, int from, int to, int promoted);
+void getMoveString(int move, char* moveString);
 
 // attack.h
 uint64 getKingAttacks(uint64 king);
@@ -302,19 +747,62 @@ int getRookAttackIndex(int square, uint64 blockers);
 
 // search.h
 int isRepetition(const Board* board);
-int fillpvArray(Board* board, int depth);
+int fillpvArray(Board* board, SearchInfo* info, int depth);
 void searchPosition(Board* board, SearchInfo* info);
 
 // evaluate.h
+void initEvaluation();
 int evaluatePosition(const Board* board);
 
+// batcheval.h
+void initBatchEvaluation();
+void setBatchPosition(PositionBatch* batch, int index, const Board* board);
+void evaluateBatch(const PositionBatch* batch, int* scores);
+
+// epd.h
+int mapReadOnlyFile(const char* path, const char** data, uint64* size);
+void unmapReadOnlyFile(const char* data, uint64 size);
+int openEpdFile(EpdFile* file, const char* path);
+const char* nextEpdLine(EpdFile* file);
+void closeEpdFile(EpdFile* file);
+int parsePerftCounts(const char* line, uint64* counts, int maxDepth);
+
+// pgn.h
+int openPgnFile(PgnFile* file, const char* path);
+void closePgnFile(PgnFile* file);
+int readPgnHeaders(PgnFile* file, PgnGame* game);
+const char* findPgnTag(const PgnGame* game, const char* name, int* length);
+int startPgnGame(Board* board, const PgnGame* game);
+int readPgnMove(PgnFile* file, Board* board);
+int parseSan(Board* board, const char* san, int length);
+
+// perfcounters.h
+int openPerfCounters(PerfCounters* counters);
+void startPerfCounters(PerfCounters* counters);
+void stopPerfCounters(PerfCounters* counters);
+void printPerfCounters(const PerfCounters* counters, uint64 nodes,
+    const char* unit);
+void closePerfCounters(PerfCounters* counters);
+
+// profiler.h
+void startPhaseProfile();
+void stopPhaseProfile();
+void printPhaseProfile(uint64 nodes, const char* unit);
+
+// nnue.h
+int loadNetwork(const char* path);
+int initAccumulators(Board* board);
+void freeAccumulators(Board* board);
+void refreshAccumulator(const Board* board, Accumulator* accumulator);
+void addFeature(Accumulator* accumulator, int piece, int square);
+void removeFeature(Accumulator* accumulator, int piece, int square);
+int evaluateNetwork(const Board* board);
+
 // functions only used in debug mode
 #ifndef NDEBUG
     int checkBoard(const Board* board);
     int validMove(int move);
-    void printPieces(const Board* board);
     void printBoard(const Board* board);
-    void getMoveString(int move, char* moveString);
     void printBitboard(uint64 bitboard);
 #endif
 
@@ -0,0 +1,231 @@
+#include "defs.h"
+
+#include <stdio.h>   // puts
+#include <stdlib.h>  // malloc, free
+#include <string.h>  // memcpy, memchr, memset
+
+#if defined(OS_WINDOWS)
+    #include <windows.h>   // CreateFileA, CreateFileMappingA, MapViewOfFile
+#elif defined(OS_LINUX)
+    #include <fcntl.h>     // open
+    #include <sys/mman.h>  // mmap, munmap, madvise
+    #include <sys/stat.h>  // fstat
+    #include <unistd.h>    // close
+#endif
+
+/*
+ * Read EPD files, one position per line, without copying them. An EPD line
+ * is a FEN string (the move counters are optional) followed by operations
+ * separated by semicolons. The perft test suites use the operations "D1 n",
+ * "D2 n", ... for the number of leaf nodes at each depth:
+ *
+ *     4k3/8/8/8/8/8/8/4K2R w K - 0 1 ;D1 15 ;D2 66 ;D3 1197
+ *
+ * The whole file is mapped into memory and nextEpdLine() returns a pointer to
+ * the start of each line in the mapping. The lines are not NUL-terminated:
+ * each one ends at its newline, which setBoardToFen() and
+ * parsePerftCounts() stop at. The last line is the only one that might not
+ * have a newline, so it is copied into a NUL-terminated buffer.
+ */
+
+/*
+ * Map the file at the given path into memory for reading. The mapping is
+ * stored in 'data' (NULL if the file is empty) and the size of the file in
+ * 'size'. Also used for PGN files (see pgn.c).
+ *
+ * path:       The path of the file. Must not be NULL.
+ * data:       Set to the mapped contents of the file.
+ * size:       Set to the size of the file in bytes.
+ *
+ * return:     1 if the file was mapped, 0 if it could not be opened or
+ *             mapped.
+ */
+int mapReadOnlyFile(const char* path, const char** data, uint64* size) {
+    *data = NULL;
+    *size = 0;
+#if defined(OS_WINDOWS)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER fileSize;
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return 0;
+    }
+    if (fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return 1;
+    }
+    *size = (uint64) fileSize.QuadPart;
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* memory = mapping == NULL ? NULL
+        : MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (mapping != NULL) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    *data = (const char*) memory;
+    return memory != NULL;
+#elif defined(OS_LINUX)
+    int file = open(path, O_RDONLY);
+    struct stat info;
+    if (file < 0 || fstat(file, &info) != 0) {
+        if (file >= 0) {
+            close(file);
+        }
+        return 0;
+    }
+    if (info.st_size == 0) {
+        close(file);
+        return 1;
+    }
+    *size = (uint64) info.st_size;
+    void* memory = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (memory == MAP_FAILED) {
+        return 0;
+    }
+    // the file is read once from start to end, so read ahead aggressively
+    madvise(memory, *size, MADV_SEQUENTIAL);
+    *data = (const char*) memory;
+    return 1;
+#endif
+}
+
+/*
+ * Open an EPD file for reading with nextEpdLine(). An empty file is opened
+ * successfully and has no lines. If something goes wrong the function prints
+ * an error message and returns 0.
+ *
+ * file:       The EpdFile to be opened. Must not be NULL.
+ * path:       The path of the file. Must not be NULL.
+ *
+ * return:     1 if the file was opened, 0 otherwise.
+ */
+int openEpdFile(EpdFile* file, const char* path) {
+    assert(file != NULL && path != NULL);
+    file->position = 0;
+    file->lastLine = NULL;
+    if (!mapReadOnlyFile(path, &file->data, &file->size)) {
+        puts("Error: openEpdFile: Could not open or map the file.");
+        return 0;
+    }
+    if (file->size != 0 && file->data[file->size - 1] != '\n') {
+        const char* start = file->data + file->size;
+        while (start > file->data && start[-1] != '\n') {
+            --start;
+        }
+        uint64 length = (uint64) (file->data + file->size - start);
+        file->lastLine = (char*) malloc(length + 1);
+        if (file->lastLine == NULL) {
+            puts("Error: openEpdFile: Not enough memory.");
+            closeEpdFile(file);
+            return 0;
+        }
+        memcpy(file->lastLine, start, length);
+        file->lastLine[length] = '\0';
+    }
+    return 1;
+}
+
+/*
+ * Return a pointer to the next line of the file, or NULL if there are no
+ * lines left. The line ends at a '\n' (possibly preceded by a '\r') or, for
+ * the last line, at a '\0'. The pointer stays valid until the file is
+ * closed.
+ *
+ * file:       The file being read. Must have been opened with openEpdFile().
+ */
+const char* nextEpdLine(EpdFile* file) {
+    assert(file != NULL);
+    if (file->position >= file->size) {
+        return NULL;
+    }
+    const char* line = file->data + file->position;
+    const char* end = (const char*) memchr(line, '\n',
+        file->size - file->position);
+    if (end == NULL) {
+        file->position = file->size;
+        return file->lastLine;
+    }
+    file->position = (uint64) (end + 1 - file->data);
+    return line;
+}
+
+/*
+ * Unmap a file mapped by mapReadOnlyFile(). Does nothing if data is NULL.
+ */
+void unmapReadOnlyFile(const char* data, uint64 size) {
+    if (data == NULL) {
+        return;
+    }
+#if defined(OS_WINDOWS)
+    (void) size;
+    UnmapViewOfFile((void*) data);
+#elif defined(OS_LINUX)
+    munmap((void*) data, size);
+#endif
+}
+
+/*
+ * Unmap the file and free the copy of its last line.
+ *
+ * file:       The file to be closed. Must not be NULL.
+ */
+void closeEpdFile(EpdFile* file) {
+    assert(file != NULL);
+    unmapReadOnlyFile(file->data, file->size);
+    free(file->lastLine);
+    file->data = NULL;
+    file->lastLine = NULL;
+    file->size = file->position = 0;
+}
+
+/*
+ * Read the perft operations ("D1 n", "D2 n", ...) of an EPD line. counts[0]
+ * is set to 1 (the position itself) and counts[depth] to the expected number
+ * of leaf nodes at that depth. Depths deeper than maxDepth are ignored, and
+ * depths that are left out are set to 0.
+ *
+ * line:       The EPD line, ending at a '\n' or '\0'. Must not be NULL.
+ * counts:     An array of maxDepth + 1 counts to be filled in.
+ * maxDepth:   The deepest depth to read.
+ *
+ * return:     The deepest depth found on the line, or 0 if there are none.
+ */
+int parsePerftCounts(const char* line, uint64* counts, int maxDepth) {
+    assert(line != NULL && counts != NULL && maxDepth >= 0);
+    memset(counts, 0, sizeof(uint64) * (maxDepth + 1));
+    counts[0] = 1;
+    int deepest = 0;
+    for (const char* c = line; *c != '\n' && *c != '\0'; ++c) {
+        if (*c != ';') {
+            continue;
+        }
+        while (c[1] == ' ') {
+            ++c;
+        }
+        if (c[1] != 'D' || c[2] < '0' || c[2] > '9') {
+            continue;
+        }
+        int depth = 0;
+        for (c += 2; *c >= '0' && *c <= '9'; ++c) {
+            depth = depth * 10 + (*c - '0');
+        }
+        while (*c == ' ') {
+            ++c;
+        }
+        uint64 count = 0;
+        for (; *c >= '0' && *c <= '9'; ++c) {
+            count = count * 10 + (uint64) (*c - '0');
+        }
+        if (depth >= 1 && depth <= maxDepth) {
+            counts[depth] = count;
+            deepest = depth > deepest ? depth : deepest;
+        }
+        --c;
+    }
+    return deepest;
+}
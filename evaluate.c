@@ -1,138 +1,190 @@
 #include "defs.h"
 
+#include <stddef.h>  // NULL
+
 /*
- * pieceValue[piece][sq] gives an estimate as to how valuable piece will be
- * when placed on the square sq. This is used for the evaluatePosition() 
- * function to favor moves that are likely to be improving moves. For example,
- * a pawn on E7 has a higher value than a pawn on E5, and a knight in the
- * center has a higher value than a knight on the edge. This will encourage the
- * engine to make improving moves such as bringing the knights to the center
- * and pushing pawns. Each value is in 100ths of a pawn, so a value of 100 is
- * worth 1 pawn.
+ * The value of each piece type in the middlegame and in the endgame, in 100ths
+ * of a pawn. Minor pieces are worth slightly less in the endgame and pawns and
+ * rooks are worth slightly more, since pawns are closer to promoting and rooks
+ * have open files to work with once the board clears out.
  */
-static const int pieceValue[NUM_PIECE_TYPES][64] = {
-    { // white pawn
-         0,  0,  0,   0,   0,  0,  0,  0,
-        10, 10,  0, -10, -10,  0, 10, 10,
-         5,  0,  0,   5,   5,  0,  0,  5,
-         0,  0, 10,  20,  20, 10,  5,  5,
-        10, 10, 20,  30,  30, 20, 10, 10,
-        30, 30, 30,  40,  40, 30, 30, 30,
-        50, 50, 50,  50,  50, 50, 50, 50,
-         0,  0,  0,   0,   0,  0,  0,  0,
-    },
-    { // white knight
-        -10, -10,  0,  0,  0,  0, -10, -10,
-          0,   0,  0,  5,  5,  0,   0,   0,
-          0,   0, 10, 10, 10, 10,   0,   0,
-          0,   5, 10, 20, 20, 10,   5,   0,
-          5,  10, 15, 20, 20, 15,  10,   5,
-          5,  10, 10, 20, 20, 10,  10,   5,
-          0,   0,  5, 10, 10,  5,   0,   0,
-        -10,   0,  0,  0,  0,  0,   0, -10,
-    },
-    { // white bishop
-        -20,  0, -10,  0,  0, -10,  0, -20,
-          0,  0,   0, 10, 10,   0,  0,   0,
-          0,  0,  10, 15, 15,  10,  0,   0,
-          0, 10,  15, 20, 20,  15, 10,   0,
-          0, 10,  15, 20, 20,  15, 10,   0,
-          0,  0,  10, 15, 15,  10,  0,   0,
-          0,  0,   0, 10, 10,   0,  0,   0,
-        -20,  0,   0,  0,  0,   0,  0, -20,
-    },
-    { // white rook
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-        25, 25, 25, 25, 25, 25, 25, 25,
-         0,  0,  5, 10, 10,  5,  0,  0,
-    },
-    { // white queen
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-    },
-    { // white king
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-    },
-    { // black pawn
-         0,  0,  0,   0,   0,  0,  0,  0,
-        20, 20, 20,  30,  30, 20, 20, 20,
-        10, 10, 10,  20,  20, 10, 10, 10,
-         5,  5,  5,  10,  10,  5,  5,  5,
-         0,  0, 10,  20,  20, 10,  0,  0,
-         5,  0,  0,   5,   5,  0,  0,  5,
-        10, 10,  0, -10, -10,  0, 10, 10,
-         0,  0,  0,   0,   0,  0,  0,  0,
-    },
-    { // black knight
-        0,   0,  0,  0,  0,  0,   0, 0,
-        0,   0,  5, 10, 10,  5,   0, 0,
-        5,  10, 10, 20, 20, 10,  10, 5,
-        5,  10, 15, 20, 20, 15,  10, 5,
-        0,   5, 10, 20, 20, 10,   5, 0,
-        0,   0, 10, 10, 10, 10,   0, 0,
-        0,   0,  0,  5,  5,  0,   0, 0,
-        0, -10,  0,  0,  0,  0, -10, 0,
-    },
-    { // black bishop
-        -20,  0,   0,  0,  0,   0,  0, -20,
-          0,  0,   0, 10, 10,   0,  0,   0,
-          0,  0,  10, 15, 15,  10,  0,   0,
-          0, 10,  15, 20, 20,  15, 10,   0,
-          0, 10,  15, 20, 20,  15, 10,   0,
-          0,  0,  10, 15, 15,  10,  0,   0,
-          0,  0,   0, 10, 10,   0,  0,   0,
-        -20,  0, -10,  0,  0, -10,  0, -20,
-    },
-    { // black rook
-         0,  0,  5, 10, 10,  5,  0,  0,
-        25, 25, 25, 25, 25, 25, 25, 25,
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-         0,  0,  5, 10, 10,  5,  0,  0,
-    },
-    { // black queen
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
+static const int materialValue[2][6] = {
+    { 100, 300, 300, 500, 900, 0 },  // middlegame
+    { 120, 290, 310, 530, 900, 0 },  // endgame
+};
+
+/*
+ * pieceSquareTable[phase][piece][sq] gives an estimate as to how valuable a
+ * white piece will be when placed on the square sq in the middlegame (phase =
+ * MIDDLEGAME) or in the endgame (phase = ENDGAME). This is used for the
+ * evaluatePosition() function to favor moves that are likely to be improving
+ * moves. For example, a pawn on E7 has a higher value than a pawn on E5, and a
+ * knight in the center has a higher value than a knight on the edge. This will
+ * encourage the engine to make improving moves such as bringing the knights to
+ * the center and pushing pawns. The king wants to hide in the corner in the
+ * middlegame and to come to the center in the endgame. Each value is in 100ths
+ * of a pawn, so a value of 100 is worth 1 pawn. The tables are written from
+ * white's perspective (the first row is rank 1) and are mirrored for black in
+ * initEvaluation().
+ */
+static const int pieceSquareTable[2][6][64] = {
+    { // middlegame
+        { // pawn
+             0,  0,  0,   0,   0,  0,  0,  0,
+            10, 10,  0, -10, -10,  0, 10, 10,
+             5,  0,  0,   5,   5,  0,  0,  5,
+             0,  0, 10,  20,  20, 10,  5,  5,
+            10, 10, 20,  30,  30, 20, 10, 10,
+            30, 30, 30,  40,  40, 30, 30, 30,
+            50, 50, 50,  50,  50, 50, 50, 50,
+             0,  0,  0,   0,   0,  0,  0,  0,
+        },
+        { // knight
+            -10, -10,  0,  0,  0,  0, -10, -10,
+              0,   0,  0,  5,  5,  0,   0,   0,
+              0,   0, 10, 10, 10, 10,   0,   0,
+              0,   5, 10, 20, 20, 10,   5,   0,
+              5,  10, 15, 20, 20, 15,  10,   5,
+              5,  10, 10, 20, 20, 10,  10,   5,
+              0,   0,  5, 10, 10,  5,   0,   0,
+            -10,   0,  0,  0,  0,  0,   0, -10,
+        },
+        { // bishop
+            -20,  0, -10,  0,  0, -10,  0, -20,
+              0,  0,   0, 10, 10,   0,  0,   0,
+              0,  0,  10, 15, 15,  10,  0,   0,
+              0, 10,  15, 20, 20,  15, 10,   0,
+              0, 10,  15, 20, 20,  15, 10,   0,
+              0,  0,  10, 15, 15,  10,  0,   0,
+              0,  0,   0, 10, 10,   0,  0,   0,
+            -20,  0,   0,  0,  0,   0,  0, -20,
+        },
+        { // rook
+             0,  0,  5, 10, 10,  5,  0,  0,
+             0,  0,  5, 10, 10,  5,  0,  0,
+             0,  0,  5, 10, 10,  5,  0,  0,
+             0,  0,  5, 10, 10,  5,  0,  0,
+             0,  0,  5, 10, 10,  5,  0,  0,
+             0,  0,  5, 10, 10,  5,  0,  0,
+            25, 25, 25, 25, 25, 25, 25, 25,
+             0,  0,  5, 10, 10,  5,  0,  0,
+        },
+        { // queen
+            -10, -5, -5,  0,  0, -5, -5, -10,
+             -5,  0,  0,  0,  0,  0,  0,  -5,
+             -5,  0,  5,  5,  5,  5,  0,  -5,
+              0,  0,  5,  5,  5,  5,  0,   0,
+              0,  0,  5,  5,  5,  5,  0,   0,
+             -5,  0,  5,  5,  5,  5,  0,  -5,
+             -5,  0,  0,  0,  0,  0,  0,  -5,
+            -10, -5, -5,  0,  0, -5, -5, -10,
+        },
+        { // king
+             20,  30,  10,   0,   0,  10,  30,  20,
+             10,  10,   0,   0,   0,   0,  10,  10,
+            -10, -20, -20, -20, -20, -20, -20, -10,
+            -20, -30, -30, -40, -40, -30, -30, -20,
+            -30, -40, -40, -50, -50, -40, -40, -30,
+            -30, -40, -40, -50, -50, -40, -40, -30,
+            -30, -40, -40, -50, -50, -40, -40, -30,
+            -30, -40, -40, -50, -50, -40, -40, -30,
+        },
     },
-    { // black king
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,
+    { // endgame
+        { // pawn
+             0,  0,  0,  0,  0,  0,  0,  0,
+             0,  0,  0,  0,  0,  0,  0,  0,
+             5,  5,  5,  5,  5,  5,  5,  5,
+            10, 10, 10, 10, 10, 10, 10, 10,
+            25, 25, 25, 25, 25, 25, 25, 25,
+            45, 45, 45, 45, 45, 45, 45, 45,
+            80, 80, 80, 80, 80, 80, 80, 80,
+             0,  0,  0,  0,  0,  0,  0,  0,
+        },
+        { // knight
+            -30, -20, -10, -10, -10, -10, -20, -30,
+            -20, -10,   0,   0,   0,   0, -10, -20,
+            -10,   0,  10,  15,  15,  10,   0, -10,
+            -10,   0,  15,  20,  20,  15,   0, -10,
+            -10,   0,  15,  20,  20,  15,   0, -10,
+            -10,   0,  10,  15,  15,  10,   0, -10,
+            -20, -10,   0,   0,   0,   0, -10, -20,
+            -30, -20, -10, -10, -10, -10, -20, -30,
+        },
+        { // bishop
+            -15, -10, -10, -10, -10, -10, -10, -15,
+            -10,   0,   0,   0,   0,   0,   0, -10,
+            -10,   0,   5,  10,  10,   5,   0, -10,
+            -10,   0,  10,  15,  15,  10,   0, -10,
+            -10,   0,  10,  15,  15,  10,   0, -10,
+            -10,   0,   5,  10,  10,   5,   0, -10,
+            -10,   0,   0,   0,   0,   0,   0, -10,
+            -15, -10, -10, -10, -10, -10, -10, -15,
+        },
+        { // rook
+             0,  0,  0,  0,  0,  0,  0,  0,
+             0,  0,  0,  0,  0,  0,  0,  0,
+             0,  0,  0,  0,  0,  0,  0,  0,
+             0,  0,  0,  0,  0,  0,  0,  0,
+             0,  0,  0,  0,  0,  0,  0,  0,
+             0,  0,  0,  0,  0,  0,  0,  0,
+            15, 15, 15, 15, 15, 15, 15, 15,
+             0,  0,  0,  0,  0,  0,  0,  0,
+        },
+        { // queen
+            -20, -10, -10, -5, -5, -10, -10, -20,
+            -10,   0,   0,  0,  0,   0,   0, -10,
+            -10,   0,   5,  5,  5,   5,   0, -10,
+             -5,   0,   5, 10, 10,   5,   0,  -5,
+             -5,   0,   5, 10, 10,   5,   0,  -5,
+            -10,   0,   5,  5,  5,   5,   0, -10,
+            -10,   0,   0,  0,  0,   0,   0, -10,
+            -20, -10, -10, -5, -5, -10, -10, -20,
+        },
+        { // king
+            -50, -30, -30, -30, -30, -30, -30, -50,
+            -30, -20,   0,   0,   0,   0, -20, -30,
+            -30, -10,  20,  30,  30,  20, -10, -30,
+            -30, -10,  30,  40,  40,  30, -10, -30,
+            -30, -10,  30,  40,  40,  30, -10, -30,
+            -30, -10,  20,  30,  30,  20, -10, -30,
+            -30, -20, -10,   0,   0, -10, -20, -30,
+            -50, -40, -30, -20, -20, -30, -40, -50,
+        },
     },
 };
 
+/*
+ * pieceValue[phase][piece][sq] is the material value plus the piece-square
+ * value of the given piece on the given square in the middlegame (phase =
+ * MIDDLEGAME) or in the endgame (phase = ENDGAME). The values are always
+ * positive for a good placement, regardless of the piece's color. The board
+ * keeps a running sum of these values for each side (board->pieceSquare)
+ * which is updated in board.c as pieces are added, removed, and moved.
+ * Filled in by initEvaluation().
+ */
+int pieceValue[2][NUM_PIECE_TYPES][64];
+
+/*
+ * Call this function once at the start of the program to fill the pieceValue
+ * table from the material values and the piece-square tables. The tables are
+ * written from white's perspective, so for black pieces the square is
+ * mirrored vertically (sq ^ 56 swaps rank 1 with rank 8, rank 2 with rank 7,
+ * etc.).
+ */
+void initEvaluation() {
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        for (int piece = 0; piece < NUM_PIECE_TYPES; ++piece) {
+            int type = piece % 6;
+            int flip = pieceColor[piece] == WHITE ? 0 : 56;
+            for (int sq = 0; sq < 64; ++sq) {
+                pieceValue[phase][piece][sq] = materialValue[phase][type]
+                    + pieceSquareTable[phase][type][sq ^ flip];
+            }
+        }
+    }
+}
+
 /*
  * Return an evaluation of a board position from the perspective of whose turn
  * it is. If it is white's turn and white is winning, return a positive score.
@@ -144,24 +196,43 @@ static const int pieceValue[NUM_PIECE_TYPES][64] = {
  * means the side to move is winning by about 2 pawns. Evaluations are used by
  * the alphaBeta algorithm to determine which move to make in the current
  * position.
- * 
+ *
+ * The middlegame and endgame scores are blended by the board's game phase: a
+ * board with all of its pieces (phase = MAX_PHASE) uses only the middlegame
+ * score and a board with only kings and pawns (phase = 0) uses only the
+ * endgame score. The phase can go above MAX_PHASE after promotions, so it is
+ * capped here, and then scaled to 1 << PHASE_SHIFT (see phaseScale) so the
+ * blend is a multiply and a shift. The pawn structure terms are looked up in
+ * the board's pawn table (see pawns.c) and the material imbalance, draw
+ * scaling, and known endgames are looked up in the board's material table
+ * (see material.c).
+ * If an NNUE network has been loaded (see nnue.c), the network's evaluation
+ * is used instead.
+ *
  * board:   The board position that is being evaluated.
- * 
+ *
  * return:  An integer representing the evaluation of the position
  */
 int evaluatePosition(const Board* board) {
-    int eval = (board->material[WHITE] - board->material[BLACK]) * 100;
-    for (int piece = 0; piece < NUM_PIECE_TYPES; ++piece) {
-        uint64 bitboard = board->pieceBitboards[piece];
-        while (bitboard) {
-            int sq = getLSB(bitboard);
-            if (pieceColor[piece] == WHITE) {
-                eval += pieceValue[piece][sq];
-            } else {
-                eval -= pieceValue[piece][sq];
-            }
-            bitboard &= bitboard - 1;
-        }
+    if (board->accumulator != NULL) {
+        return evaluateNetwork(board);
+    }
+    const MaterialEntry* materialEntry = probeMaterialTable(board);
+    if (materialEntry->evaluate != NULL) {
+        int eval = materialEntry->evaluate(board, materialEntry->strongSide);
+        return board->sideToMove == materialEntry->strongSide ? eval : -eval;
     }
+    int phase = board->phase < MAX_PHASE ? board->phase : MAX_PHASE;
+    int mg = board->pieceSquare[MIDDLEGAME][WHITE]
+        - board->pieceSquare[MIDDLEGAME][BLACK];
+    int eg = board->pieceSquare[ENDGAME][WHITE]
+        - board->pieceSquare[ENDGAME][BLACK];
+    const PawnEntry* pawns = probePawnTable(board);
+    mg += pawns->score[MIDDLEGAME] + materialEntry->imbalance;
+    eg += pawns->score[ENDGAME] + materialEntry->imbalance;
+    int weight = phaseScale[phase];
+    int eval = (mg * weight + eg * ((1 << PHASE_SHIFT) - weight))
+        >> PHASE_SHIFT;
+    eval = scaleEvaluation(board, materialEntry, eval);
     return board->sideToMove == WHITE ? eval : -eval;
 }
@@ -1,6 +1,6 @@
 #include "defs.h"
 
-#include <stdlib.h>  // srand, rand
+#define ZOBRIST_SEED 3859
 
 /* 
  * These values are the hash keys that will be used to generate position keys
@@ -23,15 +23,26 @@ static uint64 castleKeys[16];
 static uint64 enPassantKeys[64];
 
 /*
- * Generate a random 64-bit unsigned integer using stdlib.h's rand() function.
- * RAND_MAX is 32767, which is only 15 bits. To create a random 64-bit number,
- * we call rand() 5 times and shift each number into place.
+ * The state of the random number generator used to make the hash keys. The
+ * generator always starts from ZOBRIST_SEED, so the hash keys are the same
+ * every time the program runs and on every platform.
+ */
+static uint64 randomState;
+
+/*
+ * Generate a random 64-bit unsigned integer with the splitmix64 generator.
+ * The state is advanced by a fixed odd constant and then scrambled so that
+ * every bit of the output depends on every bit of the state. Unlike stdlib.h's
+ * rand(), which only gives 15 bits on some platforms and different numbers on
+ * each platform, all 64 bits are of good quality.
  * 
  * return: A random 64-bit integer.
  */
 static uint64 randomUInt64() {
-    uint64 r1 = rand(), r2 = rand(), r3 = rand(), r4 = rand(), r5 = rand();
-    return r1 | (r2 << 15) | (r3 << 30) | (r4 << 45) | (r5 << 60);
+    uint64 z = (randomState += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
 }
 
 /*
@@ -41,7 +52,7 @@ static uint64 randomUInt64() {
  * 64-bit value.
  */
 void initHashKeys() {
-    srand(3859);
+    randomState = ZOBRIST_SEED;
     sideKey = randomUInt64();
     for (int pieceType = 0; pieceType < NUM_PIECE_TYPES; ++pieceType) {
         for (int square = 0; square < 64; ++square) {
@@ -83,6 +94,51 @@ uint64 generatePositionKey(const Board* board) {
     return positionKey;
 }
 
+/*
+ * Generate the pawn key for the given chessboard. The pawn key is made from
+ * the piece hash keys of the pawns only, so two boards with the same pawn
+ * structure have the same pawn key no matter where the other pieces are. The
+ * pawn key is updated along with the position key as pawns are added,
+ * removed, and moved.
+ *
+ * board:    The board we want to generate a pawn key for. Passed in as a
+ *           const pointer which must not be NULL.
+ *
+ * return:   The pawn key for the given board.
+ */
+uint64 generatePawnKey(const Board* board) {
+    assert(board != NULL);
+    uint64 pawnKey = 0ULL;
+    for (int square = 0; square < 64; ++square) {
+        int piece = board->pieces[square];
+        if (piece == WHITE_PAWN || piece == BLACK_PAWN) {
+            pawnKey ^= pieceKeys[piece][square];
+        }
+    }
+    return pawnKey;
+}
+
+/*
+ * Generate the material key for the given chessboard. Unlike the position and
+ * pawn keys, the material key is not a Zobrist hash: it holds the number of
+ * pieces of each type, with 4 bits per piece type (see Board.materialKey).
+ * Adding a piece to the board adds 1 << (4 * piece) to the key.
+ *
+ * board:    The board we want to generate a material key for. Passed in as
+ *           a const pointer which must not be NULL.
+ *
+ * return:   The material key for the given board.
+ */
+uint64 generateMaterialKey(const Board* board) {
+    assert(board != NULL);
+    uint64 materialKey = 0ULL;
+    for (int piece = 0; piece < NUM_PIECE_TYPES; ++piece) {
+        uint64 count = countBits(board->pieceBitboards[piece]);
+        materialKey += count << (4 * piece);
+    }
+    return materialKey;
+}
+
 /*
  * Retrieve the hash key that is used to factor in which side it is to move.
  * When it is white's move, the hash key is xor-ed into the board's position
@@ -156,3 +212,28 @@ uint64 getCastleHashKey(int castlePerm) {
     assert((castlePerm & 0xFFFFFFF0) == 0);
     return castleKeys[castlePerm];
 }
+
+/*
+ * Compute a signature of all of the hash keys. Position keys are only
+ * meaningful together with the hash keys that made them, and those change if
+ * the seed or the generator changes, so a hash table that is saved to a file
+ * stores this signature and is only reused if the signature still matches.
+ *
+ * return:      A 64-bit integer that changes if any hash key changes.
+ */
+uint64 getHashKeySignature() {
+    uint64 signature = sideKey;
+    for (int pieceType = 0; pieceType < NUM_PIECE_TYPES; ++pieceType) {
+        for (int square = 0; square < 64; ++square) {
+            signature = (signature ^ pieceKeys[pieceType][square])
+                * 0x100000001B3ULL;
+        }
+    }
+    for (int castlePerm = 0; castlePerm < 16; ++castlePerm) {
+        signature = (signature ^ castleKeys[castlePerm]) * 0x100000001B3ULL;
+    }
+    for (int square = 0; square < 64; ++square) {
+        signature = (signature ^ enPassantKeys[square]) * 0x100000001B3ULL;
+    }
+    return signature;
+}
@@ -1,66 +1,619 @@
 #include "defs.h"
 
+#include <stdio.h>  // puts, snprintf
 #include <stdlib.h> // malloc, free
 #include <string.h> // memset
 
-#define HASH_TABLE_SIZE 0x100000 * 2  // 2 MB
+#include "libs/tinycthread.h"
+
+#if defined(COMPILER_MSVS)
+    #include <xmmintrin.h> // _mm_prefetch
+#endif
+
+#if defined(OS_WINDOWS)
+    #include <windows.h>   // VirtualAlloc, VirtualFree, GetLargePageMinimum
+#elif defined(OS_LINUX)
+    #include <fcntl.h>     // open
+    #include <sys/file.h>  // flock
+    #include <sys/mman.h>  // mmap, munmap, madvise, shm_open
+    #include <sys/stat.h>  // fstat
+    #include <unistd.h>    // ftruncate, close
+#endif
+
+#define DEFAULT_HASH_SIZE 2   // MB
+#define EVAL_CACHE_SIZE 0x100000 * 4  // 4 MB
+#define CACHE_LINE_SIZE 64
+#define HUGE_PAGE_SIZE 0x200000  // 2 MB
+#define CLEAR_CHUNK_SIZE 0x4000000  // 64 MB
+#define MAX_CLEAR_THREADS 64
+#define HASH_FILE_MAGIC 0x48534148  // "HASH"
+#define HASH_FILE_VERSION 1
+#define HASH_FILE_HEADER_SIZE 4096
+
+/*
+ * The header at the start of a hash table file (see mapHashTable()). The
+ * buckets start HASH_FILE_HEADER_SIZE bytes into the file so that they stay
+ * aligned to a page. The table in the file is only reused if every field
+ * matches the running program.
+ *
+ * magic:           HASH_FILE_MAGIC.
+ * version:         HASH_FILE_VERSION. Incremented whenever the layout of a
+ *                  HashEntry or HashBucket changes.
+ * bucketSize:      sizeof(HashBucket).
+ * generation:      The table's generation, so that aging carries on where
+ *                  the last program left off.
+ * numBuckets:      The number of buckets in the file.
+ * keySignature:    getHashKeySignature() of the program that wrote the
+ *                  table. The stored key fragments are useless if the hash
+ *                  keys are different.
+ */
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int bucketSize;
+    unsigned int generation;
+    uint64 numBuckets;
+    uint64 keySignature;
+} HashFileHeader;
+
+/*
+ * The size of the hash tables allocated by initHashTable(), in bytes. Always
+ * a power of 2. Set with setHashTableSize().
+ */
+static uint64 hashTableSize = (uint64) DEFAULT_HASH_SIZE << 20;
 
 /*
- * Initialize the hash table. Set hashTable->numEntries to the correct value
- * and allocate memory for the hash entries. 
+ * Set the size of the hash tables that are allocated from now on by
+ * initHashTable(). The size is rounded down to a power of 2 so that buckets
+ * can be found with a mask. Tables that are already allocated keep their
+ * size until they are initialized again.
+ *
+ * megabytes:     The new size in megabytes. Must be at least 1.
+ *
+ * return:        1 if the size was set, 0 otherwise.
+ */
+int setHashTableSize(uint64 megabytes) {
+    if (megabytes < 1 || megabytes > (1ULL << 20)) {
+        puts("Error: setHashTableSize: The size must be between 1 MB and 1 TB.");
+        return 0;
+    }
+    hashTableSize = 1ULL << 20;
+    while (hashTableSize * 2 <= megabytes << 20) {
+        hashTableSize *= 2;
+    }
+    return 1;
+}
+
+/*
+ * The file or the named block of shared memory that the hash tables set up
+ * by initHashTable() are kept in, or NULL for both if the tables are
+ * allocated privately. Set with setHashTableBacking().
+ */
+static const char* hashTableFile;
+static const char* hashTableShared;
+
+/*
+ * Keep the hash tables that are set up from now on by initHashTable() in a
+ * file (see mapHashTable()) or in shared memory (see shareHashTable())
+ * instead of allocating them. The strings are not copied, so they must stay
+ * valid for as long as tables are initialized.
+ *
+ * path:          The path of the file, or NULL.
+ * name:          The name of the shared memory block, or NULL. At most one
+ *                of path and name can be given.
+ */
+void setHashTableBacking(const char* path, const char* name) {
+    assert(path == NULL || name == NULL);
+    hashTableFile = path;
+    hashTableShared = name;
+}
+
+/*
+ * Allocate a large block of zeroed, page aligned memory for a hash table,
+ * backed by huge pages when the OS allows it. With 4 KB pages, a large table
+ * needs a TLB entry for every 4 KB, so almost every probe also misses the TLB.
+ * With 2 MB pages it needs 512 times fewer.
+ *
+ * On linux, explicit huge pages (MAP_HUGETLB) are used if the system has
+ * reserved some, and otherwise the kernel is asked to back the memory with
+ * transparent huge pages (MADV_HUGEPAGE). On Windows, large pages are used if
+ * the user has the "Lock pages in memory" privilege.
+ *
+ * size:       The number of bytes to allocate. Must be a power of 2.
+ *
+ * return:     A pointer to the memory, or NULL if it could not be allocated.
+ */
+static void* allocateTable(uint64 size) {
+#if defined(OS_WINDOWS)
+    SIZE_T largePage = GetLargePageMinimum();
+    if (largePage != 0 && size % largePage == 0) {
+        void* memory = VirtualAlloc(NULL, size,
+            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (memory != NULL) {
+            return memory;
+        }
+    }
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#elif defined(OS_LINUX)
+    void* memory = MAP_FAILED;
+    #if defined(MAP_HUGETLB)
+    if (size % HUGE_PAGE_SIZE == 0) {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    #endif
+    if (memory == MAP_FAILED) {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return NULL;
+        }
+    #if defined(MADV_HUGEPAGE)
+        madvise(memory, size, MADV_HUGEPAGE);
+    #endif
+    }
+    return memory;
+#endif
+}
+
+/*
+ * Return memory from allocateTable() to the OS.
+ */
+static void freeTable(void* memory, uint64 size) {
+#if defined(OS_WINDOWS)
+    (void) size;
+    VirtualFree(memory, 0, MEM_RELEASE);
+#elif defined(OS_LINUX)
+    munmap(memory, size);
+#endif
+}
+
+/*
+ * Map the file at the given path into memory, creating the file if it does
+ * not exist and resizing it to 'size' bytes. Changes to the memory are
+ * written back to the file by the OS.
+ *
+ * path:       The path of the file.
+ * size:       The size of the mapping in bytes.
+ *
+ * return:     A pointer to the mapped memory, or NULL if the file could not
+ *             be mapped.
+ */
+static void* mapFile(const char* path, uint64 size) {
+#if defined(OS_WINDOWS)
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+        (DWORD) (size >> 32), (DWORD) size, NULL);
+    void* memory = mapping == NULL ? NULL
+        : MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (mapping != NULL) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    return memory;
+#elif defined(OS_LINUX)
+    int file = open(path, O_RDWR | O_CREAT, 0644);
+    if (file < 0) {
+        return NULL;
+    }
+    void* memory = MAP_FAILED;
+    if (ftruncate(file, (off_t) size) == 0) {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    close(file);
+    return memory == MAP_FAILED ? NULL : memory;
+#endif
+}
+
+/*
+ * Unmap memory from mapFile() or attachSharedMemory().
+ */
+static void unmapFile(void* memory, uint64 size) {
+#if defined(OS_WINDOWS)
+    (void) size;
+    UnmapViewOfFile(memory);
+#elif defined(OS_LINUX)
+    munmap(memory, size);
+#endif
+}
+
+/*
+ * Initialize the hash table. Set hashTable->numBuckets to the correct value
+ * for the size set by setHashTableSize() and allocate memory for the hash
+ * buckets, or map them from the file or shared memory set by
+ * setHashTableBacking(). If something goes wrong the function prints an
+ * error message and returns 0.
  *
  * hashTable:     The hash table that is being initialized.
+ *
+ * return:        1 if the table was allocated, 0 otherwise.
  */
-void initHashTable(HashTable* hashTable) {
+int initHashTable(HashTable* hashTable) {
+    assert(sizeof(HashBucket) == CACHE_LINE_SIZE);
+    if (hashTableFile != NULL) {
+        return mapHashTable(hashTable, hashTableFile);
+    }
+    if (hashTableShared != NULL) {
+        return shareHashTable(hashTable, hashTableShared);
+    }
     freeHashTable(hashTable);
-    hashTable->numEntries = HASH_TABLE_SIZE / sizeof(HashEntry);
-    hashTable->table = (HashEntry*) malloc(HASH_TABLE_SIZE);
+    hashTable->table = (HashBucket*) allocateTable(hashTableSize);
+    if (hashTable->table == NULL) {
+        puts("Error: initHashTable: Could not allocate the hash table.");
+        return 0;
+    }
+    hashTable->numBuckets = hashTableSize / sizeof(HashBucket);
+    assert((hashTable->numBuckets & (hashTable->numBuckets - 1)) == 0);
     clearHashTable(hashTable);
+    return 1;
+}
+
+/*
+ * Set up a hash table in memory from mapFile() or attachSharedMemory(). If
+ * the memory already holds a table of the right size that was written with
+ * the same hash keys (see HashFileHeader), the table is reused. Otherwise the
+ * header is rewritten and the table is cleared. The magic number is written
+ * last, so that a table that was left half-cleared (Ex: the program was
+ * killed while clearing it) is cleared again the next time.
+ */
+static void attachTable(HashTable* hashTable, void* memory) {
+    HashFileHeader* header = (HashFileHeader*) memory;
+    hashTable->mapping = memory;
+    hashTable->table = (HashBucket*) ((char*) memory + HASH_FILE_HEADER_SIZE);
+    hashTable->numBuckets = hashTableSize / sizeof(HashBucket);
+    if (header->magic != HASH_FILE_MAGIC || header->version != HASH_FILE_VERSION
+        || header->bucketSize != sizeof(HashBucket)
+        || header->numBuckets != hashTable->numBuckets
+        || header->keySignature != getHashKeySignature()) {
+        header->magic = 0;
+        header->version = HASH_FILE_VERSION;
+        header->bucketSize = sizeof(HashBucket);
+        header->numBuckets = hashTable->numBuckets;
+        header->keySignature = getHashKeySignature();
+        clearHashTable(hashTable);
+        header->magic = HASH_FILE_MAGIC;
+    }
+    hashTable->generation = (unsigned char) header->generation;
+}
+
+/*
+ * Attach the hash table to the named block of shared memory, creating the
+ * block with a size of 'size' bytes if it does not exist yet. The block is
+ * locked while attachTable() checks its header and clears it, so that two
+ * processes that start at the same time do not both clear it, and a process
+ * never clears the table while another one is using it. Return 0 if the
+ * block could not be attached or if it already exists with a different
+ * size.
+ */
+static int attachSharedMemory(HashTable* hashTable, const char* name,
+    uint64 size) {
+    char fullName[256];
+#if defined(OS_WINDOWS)
+    snprintf(fullName, sizeof(fullName), "Local\\%s.lock", name);
+    HANDLE lock = CreateMutexA(NULL, FALSE, fullName);
+    if (lock == NULL) {
+        return 0;
+    }
+    WaitForSingleObject(lock, INFINITE);
+    snprintf(fullName, sizeof(fullName), "Local\\%s", name);
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+        PAGE_READWRITE, (DWORD) (size >> 32), (DWORD) size, fullName);
+    void* memory = mapping == NULL ? NULL
+        : MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (mapping != NULL) {
+        CloseHandle(mapping);
+    }
+    if (memory != NULL) {
+        attachTable(hashTable, memory);
+    }
+    ReleaseMutex(lock);
+    CloseHandle(lock);
+    return memory != NULL;
+#elif defined(OS_LINUX)
+    snprintf(fullName, sizeof(fullName), "/%s", name);
+    int block = shm_open(fullName, O_RDWR | O_CREAT, 0600);
+    if (block < 0) {
+        return 0;
+    }
+    if (flock(block, LOCK_EX) != 0) {
+        close(block);
+        return 0;
+    }
+    struct stat info;
+    void* memory = MAP_FAILED;
+    if (fstat(block, &info) == 0 && (info.st_size == 0
+        ? ftruncate(block, (off_t) size) == 0 : (uint64) info.st_size == size)) {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, block, 0);
+    }
+    if (memory != MAP_FAILED) {
+        attachTable(hashTable, memory);
+    }
+    // the mapping keeps the block open, so closing it would not release the
+    // lock until the table is unmapped
+    flock(block, LOCK_UN);
+    close(block);
+    return memory != MAP_FAILED;
+#endif
+}
+
+/*
+ * Back the hash table with a file, so that the moves it stores are kept
+ * after the program exits and can be used again the next time it runs.
+ * The table has the size set by setHashTableSize() and the file is reused
+ * if it holds a matching table (see attachTable()). If something goes wrong
+ * the function prints an error message and returns 0, and the table is left
+ * without memory.
+ *
+ * hashTable:     The hash table that is being mapped.
+ * path:          The path of the file that holds the table.
+ *
+ * return:        1 if the table was mapped, 0 otherwise.
+ */
+int mapHashTable(HashTable* hashTable, const char* path) {
+    assert(path != NULL);
+    freeHashTable(hashTable);
+    void* memory = mapFile(path, HASH_FILE_HEADER_SIZE + hashTableSize);
+    if (memory == NULL) {
+        puts("Error: mapHashTable: Could not map the hash table file.");
+        return 0;
+    }
+    attachTable(hashTable, memory);
+    return 1;
+}
+
+/*
+ * Attach the hash table to a named block of shared memory, so that several
+ * engine processes on the same machine share one table and use each other's
+ * search results. The first process to attach creates the block; later ones
+ * reuse it if it holds a matching table (see attachTable()). Every process
+ * must use the same table size. The entries are lockless (see HashEntry), so
+ * the processes can read and write the table at the same time. On linux the
+ * block stays in /dev/shm after the last process exits, so it can be
+ * attached to again; on Windows it is freed when the last process exits.
+ * If something goes wrong the function prints an error message and returns
+ * 0, and the table is left without memory.
+ *
+ * hashTable:     The hash table that is being attached.
+ * name:          The name of the shared memory block. Ex: "chess".
+ *
+ * return:        1 if the table was attached, 0 otherwise.
+ */
+int shareHashTable(HashTable* hashTable, const char* name) {
+    assert(name != NULL);
+    freeHashTable(hashTable);
+    if (!attachSharedMemory(hashTable, name,
+        HASH_FILE_HEADER_SIZE + hashTableSize)) {
+        puts("Error: shareHashTable: Could not attach to the shared memory "
+            "(it may have been created with a different size).");
+        return 0;
+    }
+    return 1;
 }
 
 /*
- * Free the dynamically allocated block of memory pointed to by
- * hashTable->table. Any data stored in the hash table will be lost.
+ * Free the memory of the hash table. Any data stored in the hash table will
+ * be lost, unless the table is backed by a file (see mapHashTable()).
  * 
  * hashTable:     The hash table whose memory we are freeing.
  */
 void freeHashTable(HashTable* hashTable) {
-    free(hashTable->table);
+    uint64 size = hashTable->numBuckets * sizeof(HashBucket);
+    if (hashTable->mapping != NULL) {
+        unmapFile(hashTable->mapping, HASH_FILE_HEADER_SIZE + size);
+    } else if (hashTable->table != NULL) {
+        freeTable(hashTable->table, size);
+    }
+    hashTable->mapping = NULL;
     hashTable->table = NULL;
+    hashTable->numBuckets = 0;
+}
+
+/*
+ * Set the hash table's generation, and save it in the file header if the
+ * table is backed by a file.
+ */
+static void setGeneration(HashTable* hashTable, unsigned char generation) {
+    hashTable->generation = generation;
+    if (hashTable->mapping != NULL) {
+        ((HashFileHeader*) hashTable->mapping)->generation = generation;
+    }
+}
+
+/*
+ * A part of a hash table that one thread sets to 0 in clearHashTable().
+ */
+typedef struct {
+    char* start;
+    uint64 size;
+} ClearJob;
+
+static int clearThread(void* args) {
+    ClearJob* job = (ClearJob*) args;
+    memset(job->start, 0, job->size);
+    return 0;
 }
 
 /*
  * Delete all data from the hash table. Any entries stored in the hash table
- * will be removed and the entire block of memory will be set to 0.
+ * will be removed and the entire block of memory will be set to 0. A large
+ * table is split into parts of at least CLEAR_CHUNK_SIZE bytes which are
+ * cleared by one thread each, since a single thread can't keep the memory
+ * bus busy. Clearing a new table also touches every page for the first time,
+ * so this spreads the page faults over the threads as well.
  * 
  * hashTable:     The hash table that is being cleared.
  */
 void clearHashTable(HashTable* hashTable) {
-    memset(hashTable->table, 0, HASH_TABLE_SIZE);
+    uint64 size = hashTable->numBuckets * sizeof(HashBucket);
+    uint64 numThreads = countProcessors();
+    if (numThreads > size / CLEAR_CHUNK_SIZE) {
+        numThreads = size / CLEAR_CHUNK_SIZE;
+    }
+    if (numThreads > MAX_CLEAR_THREADS) {
+        numThreads = MAX_CLEAR_THREADS;
+    }
+    numThreads = numThreads > 1 ? numThreads : 1;
+    ClearJob jobs[MAX_CLEAR_THREADS];
+    thrd_t threads[MAX_CLEAR_THREADS];
+    int created[MAX_CLEAR_THREADS] = { 0 };
+    uint64 chunk = size / numThreads;
+    for (uint64 i = 1; i < numThreads; ++i) {
+        jobs[i].start = (char*) hashTable->table + i * chunk;
+        jobs[i].size = i + 1 < numThreads ? chunk : size - i * chunk;
+        created[i] = thrd_create(&threads[i], clearThread, &jobs[i])
+            == thrd_success;
+        if (!created[i]) {
+            clearThread(&jobs[i]);
+        }
+    }
+    jobs[0].start = (char*) hashTable->table;
+    jobs[0].size = chunk;
+    clearThread(&jobs[0]);
+    for (uint64 i = 1; i < numThreads; ++i) {
+        if (created[i]) {
+            thrd_join(threads[i], NULL);
+        }
+    }
+    setGeneration(hashTable, 0);
+}
+
+/*
+ * Start a new generation of the hash table. Called at the start of every
+ * search instead of clearing the table, so that the moves found in earlier
+ * searches are kept until they are replaced by newer or deeper ones. A table
+ * in a file or in shared memory keeps its generation in the header, which
+ * every process using the table increments, so that the processes agree on
+ * which entries are new.
+ *
+ * hashTable:     The hash table that is being aged.
+ */
+void ageHashTable(HashTable* hashTable) {
+    if (hashTable->mapping == NULL) {
+        hashTable->generation = (unsigned char) (hashTable->generation + 1);
+        return;
+    }
+    unsigned int* generation = &((HashFileHeader*) hashTable->mapping)
+        ->generation;
+#if defined(COMPILER_GCC)
+    hashTable->generation = (unsigned char) __atomic_add_fetch(generation, 1,
+        __ATOMIC_RELAXED);
+#else
+    hashTable->generation = (unsigned char) InterlockedIncrement(
+        (volatile LONG*) generation);
+#endif
+}
+
+/*
+ * Read or write a 64-bit table entry with a single load or store, so that
+ * other threads never see half of an old entry and half of a new one. No
+ * ordering between entries is needed, so the accesses are relaxed and compile
+ * to plain moves on x86-64.
+ */
+static uint64 loadEntry(const uint64* entry) {
+#if defined(COMPILER_GCC)
+    return __atomic_load_n(entry, __ATOMIC_RELAXED);
+#else
+    return *(const volatile uint64*) entry;
+#endif
+}
+static void storeEntry(uint64* entry, uint64 value) {
+#if defined(COMPILER_GCC)
+    __atomic_store_n(entry, value, __ATOMIC_RELAXED);
+#else
+    *(volatile uint64*) entry = value;
+#endif
+}
+
+/*
+ * Pack the fields of a HashEntry into a 64-bit integer and unpack them again.
+ * See HashEntry in defs.h for the layout.
+ */
+static HashEntry makeEntry(int move, uint64 positionKey, int depth,
+    unsigned char generation) {
+    return (uint64) (unsigned int) move
+        | (positionKey >> 48) << 32
+        | (uint64) (depth < 255 ? depth : 255) << 48
+        | (uint64) generation << 56;
+}
+static int entryMove(HashEntry entry) {
+    return (int) (unsigned int) entry;
+}
+static int entryMatches(HashEntry entry, uint64 positionKey) {
+    return ((entry >> 32) & 0xFFFF) == positionKey >> 48 && entryMove(entry);
+}
+
+/*
+ * Find the bucket that the given position key belongs to. The lower bits of
+ * the key index the bucket and the upper 16 bits are stored in the entry, so
+ * the two never overlap.
+ */
+static HashBucket* findBucket(const HashTable* hashTable, uint64 positionKey) {
+    return &hashTable->table[positionKey & (hashTable->numBuckets - 1)];
+}
+
+/*
+ * Find how valuable an entry is to keep: deep entries are worth more and
+ * entries from older generations are worth less. Empty entries are worth the
+ * least. Entries from a newer generation (stored by another process that
+ * started a search after this one did) count as new. The age wraps around
+ * after 128 generations.
+ */
+static int entryWorth(const HashTable* hashTable, HashEntry entry) {
+    if (entryMove(entry) == 0) {
+        return -1000;
+    }
+    int age = (signed char) (hashTable->generation - (entry >> 56));
+    age = age > 0 ? age : 0;
+    return (int) ((entry >> 48) & 0xFF) - 8 * age;
 }
 
 /*
  * Store a move in the hash table. This function is be used to store the best
  * move in a position where the board's position key is equal to positionKey.
  * That position key is then used as the hash key into the hash table so that
- * we can quickly retrieve the best move in the position.
+ * we can quickly retrieve the best move in the position. If the position is
+ * already in its bucket, that entry is updated. Otherwise the least valuable
+ * entry in the bucket (see entryWorth()) is replaced. If another thread
+ * writes to the same bucket at the same time, one of the two entries may be
+ * lost, but the table stays valid.
  * 
  * hashTable:     The board's principal variation table which will store the
  *                move. Passed in as a pointer which must not be null.
  * move:          The move to store into the hash table. Must be a valid move.
  * positionKey:   The board's position key where move is a valid move. Used as
  *                the hash key into hashTable
+ * depth:         The depth of the search that found the move.
  */
-void storeMove(HashTable* hashTable, int move, uint64 positionKey) {
+void storeMove(HashTable* hashTable, int move, uint64 positionKey, int depth) {
     assert(hashTable != NULL);
     assert(validMove(move));
-    int index = positionKey % hashTable->numEntries;
-    hashTable->table[index].move = move;
-    hashTable->table[index].positionKey = positionKey;
+    assert(depth >= 0);
+    HashBucket* bucket = findBucket(hashTable, positionKey);
+    int replace = 0, replaceWorth = 0;
+    for (int i = 0; i < BUCKET_ENTRIES; ++i) {
+        HashEntry entry = loadEntry(&bucket->entries[i]);
+        if (entryMatches(entry, positionKey)) {
+            replace = i;
+            break;
+        }
+        int worth = entryWorth(hashTable, entry);
+        if (i == 0 || worth < replaceWorth) {
+            replace = i;
+            replaceWorth = worth;
+        }
+    }
+    storeEntry(&bucket->entries[replace],
+        makeEntry(move, positionKey, depth, hashTable->generation));
 }
 
 /*
  * Retrieve a move from the hash table using the given position / hash key.
+ * Only 16 bits of the key are checked, so the caller must check that the
+ * move is legal (see moveExists()).
  * 
  * hashTable:     The board's principal variation table which will store the
  *                move. Passed in as a pointer which must not be null.
@@ -72,9 +625,142 @@ void storeMove(HashTable* hashTable, int move, uint64 positionKey) {
  */
 int retrieveMove(HashTable* hashTable, uint64 positionKey) {
     assert(hashTable != NULL);
-    int index = positionKey % hashTable->numEntries;
-    if (hashTable->table[index].positionKey == positionKey) {
-        return hashTable->table[index].move;
+    const HashBucket* bucket = findBucket(hashTable, positionKey);
+    for (int i = 0; i < BUCKET_ENTRIES; ++i) {
+        HashEntry entry = loadEntry(&bucket->entries[i]);
+        if (entryMatches(entry, positionKey)) {
+            return entryMove(entry);
+        }
     }
     return 0;
 }
+
+/*
+ * Ask the CPU to start loading the cache line at the given address without
+ * waiting for it. Later reads of the line will not miss the cache if the
+ * line has arrived by then.
+ */
+static void prefetch(const void* address) {
+#if defined(COMPILER_GCC)
+    __builtin_prefetch(address);
+#elif defined(COMPILER_MSVS)
+    _mm_prefetch((const char*) address, _MM_HINT_T0);
+#else
+    (void) address;
+#endif
+}
+
+/*
+ * Prefetch the bucket that the given position key belongs to. makeMove()
+ * calls this as soon as the new position key is known, so that the bucket is
+ * already in the cache when the search stores or retrieves a move for the
+ * position.
+ *
+ * hashTable:     The hash table. Nothing is prefetched if it has no memory.
+ * positionKey:   The position key that will be looked up.
+ */
+void prefetchHashTable(const HashTable* hashTable, uint64 positionKey) {
+    if (hashTable->table != NULL) {
+        prefetch(findBucket(hashTable, positionKey));
+    }
+}
+
+/*
+ * Initialize the evaluation cache. Allocate one cache line more than needed
+ * so that the table can be aligned to the start of a cache line. If the
+ * memory can't be allocated the function prints an error message and
+ * returns 0.
+ *
+ * evalCache:     The evaluation cache that is being initialized.
+ *
+ * return:        1 if the cache was allocated, 0 otherwise.
+ */
+int initEvalCache(EvalCache* evalCache) {
+    freeEvalCache(evalCache);
+    evalCache->numEntries = EVAL_CACHE_SIZE / sizeof(uint64);
+    evalCache->memory = malloc(EVAL_CACHE_SIZE + CACHE_LINE_SIZE);
+    if (evalCache->memory == NULL) {
+        puts("Error: initEvalCache: Could not allocate the evaluation cache.");
+        return 0;
+    }
+    uint64 address = (uint64) evalCache->memory;
+    address = (address + CACHE_LINE_SIZE - 1) & ~(uint64) (CACHE_LINE_SIZE - 1);
+    evalCache->table = (uint64*) address;
+    clearEvalCache(evalCache);
+    return 1;
+}
+
+/*
+ * Free the dynamically allocated memory of the evaluation cache. Any data
+ * stored in the cache will be lost.
+ *
+ * evalCache:     The evaluation cache whose memory we are freeing.
+ */
+void freeEvalCache(EvalCache* evalCache) {
+    free(evalCache->memory);
+    evalCache->memory = NULL;
+    evalCache->table = NULL;
+}
+
+/*
+ * Delete all data from the evaluation cache.
+ *
+ * evalCache:     The evaluation cache that is being cleared.
+ */
+void clearEvalCache(EvalCache* evalCache) {
+    memset(evalCache->table, 0, EVAL_CACHE_SIZE);
+}
+
+/*
+ * Prefetch the evaluation cache entry of the given position key. See
+ * prefetchHashTable().
+ *
+ * evalCache:     The evaluation cache. Nothing is prefetched if it has no
+ *                memory.
+ * positionKey:   The position key that will be looked up.
+ */
+void prefetchEvalCache(const EvalCache* evalCache, uint64 positionKey) {
+    if (evalCache->table != NULL) {
+        prefetch(&evalCache->table[positionKey & (evalCache->numEntries - 1)]);
+    }
+}
+
+/*
+ * Look up the static evaluation of a position in the evaluation cache. The
+ * entry matches if its upper 48 bits match the upper 48 bits of the position
+ * key. The evaluation is stored as a 16-bit integer in the lower 16 bits.
+ *
+ * evalCache:     The evaluation cache. Passed in as a pointer which must not
+ *                be null.
+ * positionKey:   The position key of the position being evaluated.
+ * eval:          Set to the cached evaluation if the position is found.
+ *
+ * return:        1 if the position was found in the cache, 0 otherwise.
+ */
+int probeEvalCache(const EvalCache* evalCache, uint64 positionKey, int* eval) {
+    assert(evalCache != NULL && evalCache->table != NULL);
+    uint64 index = positionKey & (evalCache->numEntries - 1);
+    uint64 entry = loadEntry(&evalCache->table[index]);
+    if ((entry ^ positionKey) & ~0xFFFFULL) {
+        return 0;
+    }
+    *eval = (short) (entry & 0xFFFF);
+    return 1;
+}
+
+/*
+ * Store the static evaluation of a position in the evaluation cache,
+ * overwriting whatever was in the entry before.
+ *
+ * evalCache:     The evaluation cache. Passed in as a pointer which must not
+ *                be null.
+ * positionKey:   The position key of the position that was evaluated.
+ * eval:          The evaluation. Must fit in a 16-bit integer.
+ */
+void storeEvalCache(EvalCache* evalCache, uint64 positionKey, int eval) {
+    assert(evalCache != NULL && evalCache->table != NULL);
+    assert(eval >= -32768 && eval <= 32767);
+    uint64 entry = (positionKey & ~0xFFFFULL) | (unsigned short) eval;
+    storeEntry(&evalCache->table[positionKey & (evalCache->numEntries - 1)],
+        entry);
+}
@@ -0,0 +1,136 @@
+#include "defs.h"
+
+#include <stdio.h>   // printf, puts
+
+#if defined(OS_LINUX)
+    #include <signal.h>    // signal, SIGALRM
+    #include <sys/mman.h>  // shm_unlink
+    #include <sys/wait.h>  // waitpid
+    #include <unistd.h>    // fork, pipe, read, write, alarm, _exit
+#endif
+
+/*
+ * Test that two engine processes can use a shared hash table (see
+ * shareHashTable()) at the same time. A child process attaches to the table
+ * and stores a move while the parent attaches to the same table. The parent
+ * must be able to attach while the child still has the table (the lock
+ * taken while attaching must not be held for as long as the table is used),
+ * and each process must see the move that the other one stored and the
+ * generation that the other one started.
+ *
+ * Usage: hashtest
+ *
+ * Only runs on linux, where the processes are created with fork().
+ */
+#define SHARED_NAME "chess_hashtest"
+#define ATTACH_TIMEOUT 5  // seconds
+#define CHILD_KEY 0x123456789ABCDEF1ULL
+#define PARENT_KEY 0xFEDCBA9876543212ULL
+
+#if defined(OS_LINUX)
+
+// two moves of the starting position, stored by the child and the parent
+static int childMove, parentMove;
+
+static void attachTimedOut(int signal) {
+    (void) signal;
+    static const char message[] = "FAILED: the second process could not "
+        "attach while the first one was using the table\n";
+    write(1, message, sizeof(message) - 1);
+    _exit(1);
+}
+
+/*
+ * The child process: attach, age the table, store a move, tell the parent,
+ * and wait for the parent's move. Return the exit code of the child.
+ */
+static int runChild(int ready, int done) {
+    HashTable table = { 0 };
+    if (!shareHashTable(&table, SHARED_NAME)) {
+        return 1;
+    }
+    ageHashTable(&table);
+    storeMove(&table, childMove, CHILD_KEY, 1);
+    char c = 0;
+    int passed = write(ready, &c, 1) == 1 && read(done, &c, 1) == 1
+        && retrieveMove(&table, PARENT_KEY) == parentMove;
+    freeHashTable(&table);
+    return passed ? 0 : 1;
+}
+
+#endif
+
+int main() {
+#if defined(OS_LINUX)
+    initializeAll();
+    setHashTableSize(1);
+    static Board board;
+    MoveList list;
+    setBoardToFen(&board,
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    generateAllMoves(&board, &list);
+    childMove = list.moves[0];
+    parentMove = list.moves[1];
+    shm_unlink("/" SHARED_NAME);
+    int ready[2], done[2];
+    if (pipe(ready) != 0 || pipe(done) != 0) {
+        puts("Error: main: Could not create the pipes.");
+        return -1;
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        puts("Error: main: Could not create the child process.");
+        return -1;
+    }
+    if (child == 0) {
+        close(ready[0]);
+        close(done[1]);
+        _exit(runChild(ready[1], done[0]));
+    }
+    // if the child exits early, reading from 'ready' returns 0 instead of
+    // waiting forever
+    close(ready[1]);
+    close(done[0]);
+
+    int passed = 1;
+    char c = 0;
+    if (read(ready[0], &c, 1) != 1) {
+        puts("FAILED: the first process could not attach to the table");
+        passed = 0;
+    }
+    HashTable table = { 0 };
+    if (passed) {
+        signal(SIGALRM, attachTimedOut);
+        alarm(ATTACH_TIMEOUT);
+        passed = shareHashTable(&table, SHARED_NAME);
+        alarm(0);
+    }
+    if (passed && retrieveMove(&table, CHILD_KEY) != childMove) {
+        puts("FAILED: the move stored by the first process was not found");
+        passed = 0;
+    }
+    if (passed) {
+        ageHashTable(&table);
+        if (table.generation != 2) {
+            printf("FAILED: generation %d instead of 2\n", table.generation);
+            passed = 0;
+        }
+        storeMove(&table, parentMove, PARENT_KEY, 1);
+    }
+    write(done[1], &c, 1);
+    int status;
+    if (waitpid(child, &status, 0) != child || !WIFEXITED(status)
+        || WEXITSTATUS(status) != 0) {
+        puts("FAILED: the first process did not find the second one's move");
+        passed = 0;
+    }
+    freeHashTable(&table);
+    shm_unlink("/" SHARED_NAME);
+    puts(passed ? "Passed: two processes shared the hash table" : "FAILED");
+    return passed ? 0 : 1;
+#else
+    puts("The shared hash table test only runs on linux.");
+    return 0;
+#endif
+}
@@ -0,0 +1,275 @@
+#include "defs.h"
+
+#include <stdio.h>  // puts
+#include <stdlib.h> // malloc, free, abs
+#include <string.h> // memset
+
+#define MATERIAL_TABLE_SIZE 0x10000  // 64 KB
+
+#define KNOWN_WIN 10000
+#define SCALE_NORMAL 64
+#define SCALE_DRAWISH 16
+#define SCALE_OPPOSITE_BISHOPS 32
+#define DARK_SQUARES 0xAA55AA55AA55AA55
+
+/*
+ * Retrieve the number of pieces of type 'piece' from a material key. Each
+ * piece type has 4 bits in the key (see Board.materialKey).
+ *
+ * materialKey:    The material key whose piece count we want.
+ * piece:          The piece type to count. Must be a valid piece type.
+ *
+ * return:         The number of pieces of the given type.
+ */
+static int pieceCount(uint64 materialKey, int piece) {
+    assert(piece >= 0 && piece < NUM_PIECE_TYPES);
+    return (int) ((materialKey >> (4 * piece)) & 0xF);
+}
+
+/*
+ * Find the distance between two squares, measured in king moves. Ex: the
+ * distance between A1 and C2 is 2.
+ */
+static int squareDistance(int sq1, int sq2) {
+    int files = abs((sq1 & 7) - (sq2 & 7));
+    int ranks = abs((sq1 >> 3) - (sq2 >> 3));
+    return files > ranks ? files : ranks;
+}
+
+/*
+ * Find how far the given square is from the center of the board. The four
+ * center squares have a distance of 0 and the corners have a distance of 6.
+ */
+static int centerDistance(int sq) {
+    int file = sq & 7, rank = sq >> 3;
+    int fileDistance = file < 4 ? 3 - file : file - 4;
+    int rankDistance = rank < 4 ? 3 - rank : rank - 4;
+    return fileDistance + rankDistance;
+}
+
+/*
+ * Evaluate an endgame where the weak side has only a king and the strong side
+ * has enough material to force a checkmate (a queen or a rook, possibly with
+ * other pieces). The only thing left to do is to push the weak king to the
+ * edge of the board and bring the strong king closer to it, so the normal
+ * evaluation is replaced by a known win plus a bonus for doing that.
+ *
+ * board:         The board position that is being evaluated.
+ * strongSide:    The side with the extra material (WHITE or BLACK).
+ *
+ * return:        The evaluation from the strong side's perspective.
+ */
+static int evaluateKXK(const Board* board, int strongSide) {
+    int strongKing = getLSB(board->pieceBitboards[pieces[strongSide][KING]]);
+    int weakKing = getLSB(board->pieceBitboards[pieces[!strongSide][KING]]);
+    int eval = KNOWN_WIN + board->pieceSquare[ENDGAME][strongSide];
+    eval += 20 * centerDistance(weakKing);
+    eval += 10 * (7 - squareDistance(strongKing, weakKing));
+    return eval;
+}
+
+/*
+ * Evaluate the king, bishop, and knight vs king endgame. Checkmate can only
+ * be forced in a corner of the same color as the bishop, so the weak king is
+ * pushed toward the closest of those two corners instead of any edge.
+ *
+ * board:         The board position that is being evaluated.
+ * strongSide:    The side with the bishop and knight (WHITE or BLACK).
+ *
+ * return:        The evaluation from the strong side's perspective.
+ */
+static int evaluateKBNK(const Board* board, int strongSide) {
+    int strongKing = getLSB(board->pieceBitboards[pieces[strongSide][KING]]);
+    int weakKing = getLSB(board->pieceBitboards[pieces[!strongSide][KING]]);
+    uint64 bishop = board->pieceBitboards[pieces[strongSide][BISHOP]];
+    int corner1 = (bishop & DARK_SQUARES) ? A1 : A8;
+    int corner2 = (bishop & DARK_SQUARES) ? H8 : H1;
+    int d1 = squareDistance(weakKing, corner1);
+    int d2 = squareDistance(weakKing, corner2);
+    int eval = KNOWN_WIN + board->pieceSquare[ENDGAME][strongSide];
+    eval += 40 * (7 - (d1 < d2 ? d1 : d2));
+    eval += 10 * (7 - squareDistance(strongKing, weakKing));
+    return eval;
+}
+
+/*
+ * Find how much the given side's winning chances should be scaled down by
+ * when it is ahead. Without pawns, a side can't win if it has at most a minor
+ * piece or only two knights, and winning is difficult if it is ahead by at
+ * most a minor piece (ex: rook vs bishop).
+ *
+ * materialKey:   The material key of the position.
+ * side:          The side whose scale factor we want.
+ *
+ * return:        A scale factor out of SCALE_NORMAL.
+ */
+static int scaleFactor(uint64 materialKey, int side) {
+    if (pieceCount(materialKey, pieces[side][PAWN]) > 0) {
+        return SCALE_NORMAL;
+    }
+    int ownMaterial = 0, otherMaterial = 0;
+    for (int type = KNIGHT; type <= QUEEN; ++type) {
+        ownMaterial += pieceCount(materialKey, pieces[side][type])
+            * material[type];
+        otherMaterial += pieceCount(materialKey, pieces[!side][type])
+            * material[type];
+    }
+    int knights = pieceCount(materialKey, pieces[side][KNIGHT]);
+    if (ownMaterial <= 3 || (knights == 2 && ownMaterial == 6)) {
+        return 0;
+    }
+    if (ownMaterial - otherMaterial <= 3) {
+        return SCALE_DRAWISH;
+    }
+    return SCALE_NORMAL;
+}
+
+/*
+ * Find the material imbalance bonus of one side in 100ths of a pawn. A side
+ * gets a bonus for having the bishop pair. Knights get better and rooks get
+ * worse as more pawns are on the board, since the board is more closed.
+ */
+static int imbalance(uint64 materialKey, int side) {
+    int pawns = pieceCount(materialKey, pieces[side][PAWN]);
+    int bonus = pieceCount(materialKey, pieces[side][BISHOP]) >= 2 ? 30 : 0;
+    bonus += pieceCount(materialKey, pieces[side][KNIGHT]) * (pawns - 5) * 3;
+    bonus -= pieceCount(materialKey, pieces[side][ROOK]) * (pawns - 5) * 6;
+    return bonus;
+}
+
+/*
+ * Fill in a material table entry for the given material key: the material
+ * imbalance, the scale factors, and (if the material matches a known
+ * endgame) the specialized evaluation function to use.
+ *
+ * entry:         The entry that is being filled in.
+ * materialKey:   The material key of the entry.
+ */
+static void computeMaterialEntry(MaterialEntry* entry, uint64 materialKey) {
+    memset(entry, 0, sizeof(MaterialEntry));
+    entry->materialKey = materialKey;
+    entry->imbalance = (short) (imbalance(materialKey, WHITE)
+        - imbalance(materialKey, BLACK));
+    entry->scale[WHITE] = (unsigned char) scaleFactor(materialKey, WHITE);
+    entry->scale[BLACK] = (unsigned char) scaleFactor(materialKey, BLACK);
+
+    // Each side has one bishop, pawns, and no other pieces. Whether the
+    // bishops are on opposite colors is checked in the evaluation.
+    uint64 pieceMask = 0ULL;
+    for (int type = KNIGHT; type <= QUEEN; ++type) {
+        pieceMask |= 0xFULL << (4 * pieces[WHITE][type]);
+        pieceMask |= 0xFULL << (4 * pieces[BLACK][type]);
+    }
+    uint64 oneBishopEach = 1ULL << (4 * WHITE_BISHOP)
+        | 1ULL << (4 * BLACK_BISHOP);
+    if ((materialKey & pieceMask) == oneBishopEach) {
+        entry->flags |= OPPOSITE_BISHOPS;
+    }
+
+    // Look for endgames where one side has only a king.
+    for (int side = WHITE; side <= BLACK; ++side) {
+        uint64 weakMask = 0ULL;
+        for (int type = PAWN; type <= QUEEN; ++type) {
+            weakMask |= 0xFULL << (4 * pieces[!side][type]);
+        }
+        if ((materialKey & weakMask) != 0ULL) {
+            continue;
+        }
+        int knights = pieceCount(materialKey, pieces[side][KNIGHT]);
+        int bishops = pieceCount(materialKey, pieces[side][BISHOP]);
+        int rooks = pieceCount(materialKey, pieces[side][ROOK]);
+        int queens = pieceCount(materialKey, pieces[side][QUEEN]);
+        int pawns = pieceCount(materialKey, pieces[side][PAWN]);
+        if (rooks + queens > 0) {
+            entry->evaluate = evaluateKXK;
+            entry->strongSide = (unsigned char) side;
+        } else if (knights == 1 && bishops == 1 && pawns == 0) {
+            entry->evaluate = evaluateKBNK;
+            entry->strongSide = (unsigned char) side;
+        }
+    }
+}
+
+/*
+ * Initialize the material table. Set materialTable->numEntries to the correct
+ * value and allocate memory for the material entries. The number of entries
+ * is a power of 2 so that an index can be found with a mask. If the memory
+ * can't be allocated the function prints an error message and returns 0.
+ *
+ * materialTable:    The material table that is being initialized.
+ *
+ * return:           1 if the table was allocated, 0 otherwise.
+ */
+int initMaterialTable(MaterialTable* materialTable) {
+    freeMaterialTable(materialTable);
+    materialTable->numEntries = MATERIAL_TABLE_SIZE / sizeof(MaterialEntry);
+    assert((materialTable->numEntries & (materialTable->numEntries - 1)) == 0);
+    materialTable->table = (MaterialEntry*) malloc(MATERIAL_TABLE_SIZE);
+    if (materialTable->table == NULL) {
+        puts("Error: initMaterialTable: Could not allocate the material "
+            "table.");
+        return 0;
+    }
+    memset(materialTable->table, 0, MATERIAL_TABLE_SIZE);
+    return 1;
+}
+
+/*
+ * Free the dynamically allocated block of memory pointed to by
+ * materialTable->table. Any data stored in the material table will be lost.
+ *
+ * materialTable:    The material table whose memory we are freeing.
+ */
+void freeMaterialTable(MaterialTable* materialTable) {
+    free(materialTable->table);
+    materialTable->table = NULL;
+}
+
+/*
+ * Retrieve the material table entry for the given board. The entry for each
+ * material key is computed the first time the key is seen and is then reused.
+ * Material keys are mostly 0 bits, so the key is multiplied by a large odd
+ * constant to spread it over the table. A material key is never 0 (both
+ * kings are always on the board), so an empty entry never matches.
+ *
+ * board:      The board whose material entry we want. Passed in as a const
+ *             pointer which must not be NULL.
+ *
+ * return:     A pointer to the material table entry for the board.
+ */
+const MaterialEntry* probeMaterialTable(const Board* board) {
+    assert(board != NULL && board->materialTable.table != NULL);
+    uint64 hash = (board->materialKey * 0x9E3779B97F4A7C15ULL) >> 32;
+    uint64 index = hash & (board->materialTable.numEntries - 1);
+    MaterialEntry* entry = &board->materialTable.table[index];
+    if (entry->materialKey != board->materialKey) {
+        computeMaterialEntry(entry, board->materialKey);
+    }
+    return entry;
+}
+
+/*
+ * Scale an evaluation down toward 0 (a draw) if the side that is ahead will
+ * have a hard time winning with the material on the board. The scale factors
+ * are stored in the material entry. Endgames with only bishops of opposite
+ * colors and pawns are also drawish, but whether the bishops are on opposite
+ * colors can't be known from the material alone, so it is checked here.
+ *
+ * board:      The board position that is being evaluated.
+ * entry:      The material table entry for the board.
+ * eval:       The evaluation of the board from white's perspective.
+ *
+ * return:     The scaled evaluation from white's perspective.
+ */
+int scaleEvaluation(const Board* board, const MaterialEntry* entry, int eval) {
+    int scale = entry->scale[eval > 0 ? WHITE : BLACK];
+    if (entry->flags & OPPOSITE_BISHOPS) {
+        uint64 white = board->pieceBitboards[WHITE_BISHOP];
+        uint64 black = board->pieceBitboards[BLACK_BISHOP];
+        if (!(white & DARK_SQUARES) != !(black & DARK_SQUARES)
+            && scale > SCALE_OPPOSITE_BISHOPS) {
+            scale = SCALE_OPPOSITE_BISHOPS;
+        }
+    }
+    return eval * scale / SCALE_NORMAL;
+}
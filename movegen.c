@@ -91,14 +91,14 @@ static int getMove(int from, int to, int captured, int promoted, int flags) {
 }
 
 /* 
- * Add the given move to the movelist. Update the promotion if the move is a
- * pawn start, castle, en passant, or promotion.
+ * Update the move score if the move is a pawn start, castle, en passant, or
+ * promotion. The scores of other moves are set by the caller.
  *
- * move:      the move to be added to the list.
- * list:      a struct which contains an array of moves
+ * move:      the move whose score is updated.
+ *
+ * return:    the move with its final score.
  */
-static void addMove(int move, MoveList* list) {
-    assert(list->numMoves >= 0);
+static int scoreSpecialMove(int move) {
     int capture;
     switch (move & MOVE_FLAGS) {
         case PAWN_START_FLAG: move |= (9 << 25); break;
@@ -112,6 +112,19 @@ static void addMove(int move, MoveList* list) {
             move += (promotionScore[(move >> 16) & 0xF] + capture) << 25;
             
     }
+    return move;
+}
+
+/* 
+ * Add the given move to the movelist. Update the promotion if the move is a
+ * pawn start, castle, en passant, or promotion.
+ *
+ * move:      the move to be added to the list.
+ * list:      a struct which contains an array of moves
+ */
+static void addMove(int move, MoveList* list) {
+    assert(list->numMoves >= 0);
+    move = scoreSpecialMove(move);
     assert(validMove(move));
     list->moves[list->numMoves++] = move;
 }
@@ -344,6 +357,7 @@ static void generateBlackCastleMoves(const Board* board, MoveList* list) {
  */
 void generateAllMoves(const Board* board, MoveList* list) {
     assert(board != NULL && list != NULL && checkBoard(board));
+    PROFILE_BEGIN(PHASE_MOVEGEN);
     list->numMoves = 0;
     uint64 samePieces, allPieces = board->colorBitboards[BOTH_COLORS];
     uint64 kings, knights, rooks, bishops, queens;
@@ -392,7 +406,52 @@ void generateAllMoves(const Board* board, MoveList* list) {
     }
     uint64 attacks = getKingAttacks(kings);
     generatePieceMoves(board, list, attacks & ~samePieces, getLSB(kings));
+    PROFILE_SWITCH(PHASE_SORT);
     qsort(list->moves, list->numMoves, sizeof(int), compareMoves);
+    PROFILE_END();
+}
+
+/*
+ * Build the move of the piece on the 'from' square to the 'to' square without
+ * generating the other moves, for move input such as SAN (see pgn.c). The
+ * captured piece, flags, and move score are found from the board, so the
+ * move is identical to the one generateAllMoves() would generate. The move
+ * is not checked: the piece must be able to move from 'from' to 'to', and
+ * makeMove() checks that it does not leave the king in check.
+ *
+ * board:       The current chess position. Must not be NULL.
+ * from:        The square of the piece to move. Must not be empty.
+ * to:          The square the piece moves to.
+ * promoted:    The piece a pawn promotes to, or NO_PIECE.
+ *
+ * return:      The move.
+ */
+int buildMove(const Board* board, int from, int to, int promoted) {
+    assert(board != NULL && board->pieces[from] != NO_PIECE);
+    int piece = board->pieces[from];
+    int captured = board->pieces[to];
+    int flags = captured == NO_PIECE ? 0 : CAPTURE_FLAG;
+    int score = captured == NO_PIECE ? moveScore[piece]
+        : captureScore[piece][captured];
+    if (piece == WHITE_PAWN || piece == BLACK_PAWN) {
+        if ((1ULL << to) == board->enPassantSquare) {
+            return scoreSpecialMove(getMove(from, to, NO_PIECE, NO_PIECE,
+                EN_PASSANT_FLAG));
+        }
+        if (to - from == 16 || from - to == 16) {
+            return scoreSpecialMove(getMove(from, to, NO_PIECE, NO_PIECE,
+                PAWN_START_FLAG));
+        }
+        if (promoted != NO_PIECE) {
+            flags |= PROMOTION_FLAG;
+        }
+    } else if ((piece == WHITE_KING || piece == BLACK_KING)
+        && (to - from == 2 || from - to == 2)) {
+        return scoreSpecialMove(getMove(from, to, NO_PIECE, NO_PIECE,
+            CASTLE_FLAG));
+    }
+    return scoreSpecialMove(getMove(from, to, captured, promoted, flags)
+        | (score << 25));
 }
 
 /*
@@ -408,16 +467,41 @@ void generateAllMoves(const Board* board, MoveList* list) {
  * return:      1 if the move exists and is legal, 0 otherwise.
  */
 int moveExists(Board* board, int move) {
+    PROFILE_BEGIN(PHASE_LEGALITY);
 	MoveList list;
     generateAllMoves(board, &list);
 	for (int i = 0; i < list.numMoves; ++i) {
         if (move == list.moves[i]) {
-            if (makeMove(board, move)) {
+            int legal = makeMove(board, move);
+            if (legal) {
                 undoMove(board);
-                return 1;
             }
-            return 0;
+            PROFILE_END();
+            return legal;
         }
 	}
+    PROFILE_END();
 	return 0;
 }
+
+/*
+ * Given a move on the chessboard, fill the 'moveString' parameter with the
+ * text version of the move. For example, if the 'from' square is 8 (a2) and
+ * the 'to' square is 24 (a4), the moveString will be "a2a4". Also, if the move
+ * results in a promotion, append the letter of the promoted piece to the move
+ * string. For example: "a7a8Q".
+ * 
+ * move:        A 32-bit integer with all the information of the move.
+ * moveString:  A string where the text-version of the move will be placed. The
+ *              string must be at least 6 chars long.
+ */
+void getMoveString(int move, char* moveString) {
+    assert(validMove(move));
+    const char* pieceChar = "PNBRQKpnbrqk\0\0\0\0\0";
+    moveString[0] = (move & 0x3F) % 8 + 'a';
+    moveString[1] = (move & 0x3F) / 8 + '1';
+    moveString[2] = ((move >> 6) & 0x3F) % 8 + 'a';
+    moveString[3] = ((move >> 6) & 0x3F) / 8 + '1';
+    moveString[4] = pieceChar[(move >> 16) & 0xF];
+    moveString[5] = 0;
+}
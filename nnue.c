@@ -0,0 +1,308 @@
+#include "defs.h"
+
+#include <stdio.h>   // FILE, fopen, fread, fclose, puts
+#include <stdlib.h>  // malloc, free
+#include <string.h>  // memcpy
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+/*
+ * An efficiently updatable neural network (NNUE) that can replace the
+ * hand-written evaluation. The network has 3 layers:
+ *
+ * (1) The feature transformer. Each of the 768 input features is a piece type
+ *     on a square (12 * 64). The layer is computed twice, once from each
+ *     side's perspective (for black the board is flipped and the colors are
+ *     swapped), into 2 * NNUE_HIDDEN int16 values. Only a few features change
+ *     each move, so these values (the accumulator) are kept in the board and
+ *     updated as pieces are added, removed, and moved.
+ * (2) A dense layer from the 2 * NNUE_HIDDEN clipped accumulator values
+ *     (side to move first) to NNUE_L1 values, with int8 weights.
+ * (3) A dense layer from the NNUE_L1 clipped values to the output, with int8
+ *     weights.
+ *
+ * The clipped activations are in the range [0, 127] (127 = 1.0). The layer 2
+ * weights are scaled by 64, so its outputs are shifted right by 6 before
+ * being clipped. The final output is divided by NNUE_OUTPUT_SCALE to get an
+ * evaluation in 100ths of a pawn, which is clamped to NNUE_EVAL_BOUND so that
+ * it always fits in the 16 bits of an eval cache entry and can never be taken
+ * for a mate score by the search.
+ */
+#define NNUE_INPUTS 768
+#define NNUE_L1 32
+#define NNUE_WEIGHT_SHIFT 6
+#define NNUE_OUTPUT_SCALE 16
+#define NNUE_EVAL_BOUND 20000
+#define NNUE_MAGIC 0x45554E4E  // "NNUE"
+#define NNUE_VERSION 1
+
+static short featureBiases[NNUE_HIDDEN];
+static short featureWeights[NNUE_INPUTS][NNUE_HIDDEN];
+static int l1Biases[NNUE_L1];
+static signed char l1Weights[NNUE_L1][2 * NNUE_HIDDEN];
+static int l2Bias;
+static signed char l2Weights[NNUE_L1];
+static int networkLoaded = 0;
+
+/*
+ * Read a block of 'size' bytes from the file into 'dest'. Return 1 if all the
+ * bytes were read, 0 otherwise.
+ */
+static int readBlock(FILE* file, void* dest, size_t size) {
+    return fread(dest, 1, size, file) == size;
+}
+
+/*
+ * Load the network weights from a file. The file starts with a header of 4
+ * 32-bit integers: the magic number "NNUE", the version, NNUE_HIDDEN, and
+ * NNUE_L1. After the header come the feature biases and weights (int16),
+ * the layer 2 biases (int32) and weights (int8), and the layer 3 bias (int32)
+ * and weights (int8), all little-endian and in the order of the arrays above.
+ * If something goes wrong the function prints an error message and returns 0
+ * and the hand-written evaluation continues to be used.
+ *
+ * path:       The path to the weights file. Must not be NULL.
+ *
+ * return:     1 if the network was loaded, 0 otherwise.
+ */
+int loadNetwork(const char* path) {
+    assert(path != NULL);
+    networkLoaded = 0;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        puts("Error: loadNetwork: Could not open the weights file.");
+        return 0;
+    }
+    unsigned int header[4];
+    int ok = readBlock(file, header, sizeof(header));
+    if (!ok || header[0] != NNUE_MAGIC || header[1] != NNUE_VERSION
+        || header[2] != NNUE_HIDDEN || header[3] != NNUE_L1) {
+        puts("Error: loadNetwork: Invalid header or wrong network size.");
+        fclose(file);
+        return 0;
+    }
+    ok = readBlock(file, featureBiases, sizeof(featureBiases))
+        && readBlock(file, featureWeights, sizeof(featureWeights))
+        && readBlock(file, l1Biases, sizeof(l1Biases))
+        && readBlock(file, l1Weights, sizeof(l1Weights))
+        && readBlock(file, &l2Bias, sizeof(l2Bias))
+        && readBlock(file, l2Weights, sizeof(l2Weights))
+        && fgetc(file) == EOF;
+    fclose(file);
+    if (!ok) {
+        puts("Error: loadNetwork: The weights file has the wrong size.");
+        return 0;
+    }
+    networkLoaded = 1;
+    return 1;
+}
+
+/*
+ * Find the index of the input feature for the given piece on the given
+ * square from the given side's perspective. From black's perspective the
+ * board is flipped vertically and the colors of the pieces are swapped, so
+ * that both perspectives see their own pieces moving up the board.
+ */
+static int featureIndex(int perspective, int piece, int square) {
+    if (perspective == BLACK) {
+        piece = piece < BLACK_PAWN ? piece + 6 : piece - 6;
+        square ^= 56;
+    }
+    return piece * 64 + square;
+}
+
+/*
+ * Add or subtract the weights of one feature to or from one perspective of
+ * the accumulator. These are the innermost loops of the incremental update.
+ */
+static void addWeights(short* values, const short* weights) {
+#if defined(__AVX2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) &values[i]);
+        __m256i w = _mm256_loadu_si256((const __m256i*) &weights[i]);
+        _mm256_storeu_si256((__m256i*) &values[i], _mm256_add_epi16(v, w));
+    }
+#else
+    for (int i = 0; i < NNUE_HIDDEN; ++i) {
+        values[i] = (short) (values[i] + weights[i]);
+    }
+#endif
+}
+static void subtractWeights(short* values, const short* weights) {
+#if defined(__AVX2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) &values[i]);
+        __m256i w = _mm256_loadu_si256((const __m256i*) &weights[i]);
+        _mm256_storeu_si256((__m256i*) &values[i], _mm256_sub_epi16(v, w));
+    }
+#else
+    for (int i = 0; i < NNUE_HIDDEN; ++i) {
+        values[i] = (short) (values[i] - weights[i]);
+    }
+#endif
+}
+
+/*
+ * Update the accumulator for a piece being added to or removed from the
+ * given square. Called by addPiece() and clearPiece() in board.c. Moving a
+ * piece is a removal followed by an addition.
+ *
+ * accumulator:    The accumulator being updated. Must not be NULL.
+ * piece:          The piece being added or removed.
+ * square:         The square the piece is added to or removed from.
+ */
+void addFeature(Accumulator* accumulator, int piece, int square) {
+    for (int side = WHITE; side <= BLACK; ++side) {
+        int feature = featureIndex(side, piece, square);
+        addWeights(accumulator->values[side], featureWeights[feature]);
+    }
+}
+void removeFeature(Accumulator* accumulator, int piece, int square) {
+    for (int side = WHITE; side <= BLACK; ++side) {
+        int feature = featureIndex(side, piece, square);
+        subtractWeights(accumulator->values[side], featureWeights[feature]);
+    }
+}
+
+/*
+ * Compute the accumulator for the given board from scratch: the feature
+ * biases plus the weights of every piece on the board.
+ *
+ * board:          The board whose pieces are added to the accumulator.
+ * accumulator:    The accumulator to be filled. Must not be NULL.
+ */
+void refreshAccumulator(const Board* board, Accumulator* accumulator) {
+    assert(networkLoaded);
+    memcpy(accumulator->values[WHITE], featureBiases, sizeof(featureBiases));
+    memcpy(accumulator->values[BLACK], featureBiases, sizeof(featureBiases));
+    for (int square = 0; square < 64; ++square) {
+        if (board->pieces[square] != NO_PIECE) {
+            addFeature(accumulator, board->pieces[square], square);
+        }
+    }
+}
+
+/*
+ * Allocate the board's accumulator stack and compute the accumulator for the
+ * board's current position. The stack has one accumulator per ply: makeMove()
+ * pushes a copy of the current accumulator and updates it, and undoMove()
+ * pops it. If no network is loaded, the board's accumulator is set to NULL
+ * and the hand-written evaluation is used instead. If the stack can't be
+ * allocated the function prints an error message and returns 0.
+ *
+ * board:      The board whose accumulators are initialized.
+ *
+ * return:     1 if the accumulators were set up (or no network is loaded),
+ *             0 otherwise.
+ */
+int initAccumulators(Board* board) {
+    freeAccumulators(board);
+    if (!networkLoaded) {
+        return 1;
+    }
+    size_t size = sizeof(Accumulator) * (MAX_GAME_MOVES + 1);
+    board->accumulatorStack = (Accumulator*) malloc(size);
+    if (board->accumulatorStack == NULL) {
+        puts("Error: initAccumulators: Could not allocate the accumulators.");
+        return 0;
+    }
+    board->accumulator = board->accumulatorStack;
+    refreshAccumulator(board, board->accumulator);
+    return 1;
+}
+
+/*
+ * Free the board's accumulator stack.
+ *
+ * board:      The board whose accumulators are freed.
+ */
+void freeAccumulators(Board* board) {
+    free(board->accumulatorStack);
+    board->accumulatorStack = NULL;
+    board->accumulator = NULL;
+}
+
+/*
+ * Clip the accumulator values of one perspective to [0, 127] and write them
+ * to 'output' as unsigned bytes.
+ */
+static void clipAccumulator(const short* values, unsigned char* output) {
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    for (int i = 0; i < NNUE_HIDDEN; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) &values[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i*) &values[i + 16]);
+        // packs saturates to [-128, 127] and interleaves the 128-bit lanes,
+        // so clip at 0 and put the lanes back in order.
+        __m256i packed = _mm256_max_epi8(_mm256_packs_epi16(a, b), zero);
+        packed = _mm256_permute4x64_epi64(packed, 0xD8);
+        _mm256_storeu_si256((__m256i*) &output[i], packed);
+    }
+#else
+    for (int i = 0; i < NNUE_HIDDEN; ++i) {
+        int v = values[i];
+        output[i] = (unsigned char) (v < 0 ? 0 : v > 127 ? 127 : v);
+    }
+#endif
+}
+
+/*
+ * Compute the dot product of 'size' unsigned bytes with 'size' signed bytes.
+ * 'size' must be a multiple of 32. The products are in [0, 127] * [-128, 127]
+ * so adjacent pairs can be added in 16 bits without overflowing.
+ */
+static int dotProduct(const unsigned char* input, const signed char* weights,
+    int size) {
+#if defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < size; i += 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i*) &input[i]);
+        __m256i w = _mm256_loadu_si256((const __m256i*) &weights[i]);
+        __m256i products = _mm256_maddubs_epi16(in, w);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+        _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+    return _mm_cvtsi128_si32(half);
+#else
+    int sum = 0;
+    for (int i = 0; i < size; ++i) {
+        sum += input[i] * weights[i];
+    }
+    return sum;
+#endif
+}
+
+/*
+ * Return the network's evaluation of the board from the perspective of the
+ * side to move, in 100ths of a pawn. The board's accumulator must be up to
+ * date (it is kept up to date by makeMove() and undoMove()).
+ *
+ * board:   The board position that is being evaluated. Its accumulator must
+ *          not be NULL.
+ *
+ * return:  An integer representing the evaluation of the position, between
+ *          -NNUE_EVAL_BOUND and NNUE_EVAL_BOUND.
+ */
+int evaluateNetwork(const Board* board) {
+    assert(board->accumulator != NULL);
+    unsigned char input[2 * NNUE_HIDDEN];
+    unsigned char hidden[NNUE_L1];
+    int us = board->sideToMove;
+    clipAccumulator(board->accumulator->values[us], input);
+    clipAccumulator(board->accumulator->values[!us], input + NNUE_HIDDEN);
+    for (int i = 0; i < NNUE_L1; ++i) {
+        int v = l1Biases[i] + dotProduct(input, l1Weights[i], 2 * NNUE_HIDDEN);
+        v >>= NNUE_WEIGHT_SHIFT;
+        hidden[i] = (unsigned char) (v < 0 ? 0 : v > 127 ? 127 : v);
+    }
+    int output = (l2Bias + dotProduct(hidden, l2Weights, NNUE_L1))
+        / NNUE_OUTPUT_SCALE;
+    return output < -NNUE_EVAL_BOUND ? -NNUE_EVAL_BOUND
+        : output > NNUE_EVAL_BOUND ? NNUE_EVAL_BOUND : output;
+}
@@ -0,0 +1,186 @@
+#include "defs.h"
+
+#include <stdio.h>  // puts
+#include <stdlib.h> // malloc, free
+#include <string.h> // memset
+
+#define PAWN_TABLE_SIZE 0x100000  // 1 MB
+
+/*
+ * Bonuses and penalties for the pawn structure terms, in 100ths of a pawn.
+ * Indexed [phase] where phase is MIDDLEGAME or ENDGAME. Passed pawns get a
+ * bonus based on how far they have advanced (indexed by the rank from the
+ * pawn's own side, so index 6 is a pawn on the 7th rank). The structure
+ * weaknesses matter more in the endgame, where the pawns can be attacked by
+ * the king and there are fewer pieces to defend them.
+ */
+static const int passedBonus[2][8] = {
+    { 0,  0,  5, 10, 20, 35, 60, 0 },
+    { 0, 10, 15, 25, 45, 75, 120, 0 },
+};
+static const int doubledPenalty[2] = { 10, 20 };
+static const int isolatedPenalty[2] = { 10, 15 };
+static const int backwardPenalty[2] = { 8, 10 };
+
+/*
+ * Fill every square north (toward rank 8) or south (toward rank 1) of each
+ * 1-bit in the given bitboard, including the square of the 1-bit itself. Ex:
+ * northFill() of a pawn on D4 has a 1-bit on D4, D5, D6, D7, and D8.
+ *
+ * bitboard:    The bitboard to be filled.
+ *
+ * return:      The filled bitboard.
+ */
+static uint64 northFill(uint64 bitboard) {
+    bitboard |= bitboard << 8;
+    bitboard |= bitboard << 16;
+    return bitboard | (bitboard << 32);
+}
+static uint64 southFill(uint64 bitboard) {
+    bitboard |= bitboard >> 8;
+    bitboard |= bitboard >> 16;
+    return bitboard | (bitboard >> 32);
+}
+
+/*
+ * Shift every 1-bit in the given bitboard one file to the east and one file to
+ * the west and return both shifts combined. Bits do not wrap around from the
+ * H file to the A file or vice versa.
+ *
+ * bitboard:    The bitboard to be shifted.
+ *
+ * return:      A bitboard of every square that is next to a 1-bit in the
+ *              given bitboard on the same rank.
+ */
+static uint64 adjacentFiles(uint64 bitboard) {
+    return ((bitboard << 1) & ~FILE_A) | ((bitboard >> 1) & ~FILE_H);
+}
+
+/*
+ * Evaluate the pawn structure of one side. The pawns are always seen from
+ * white's perspective (moving toward rank 8), so to evaluate black's pawns
+ * the caller flips both bitboards with flipBitboard() first. The middlegame
+ * and endgame scores are added to score[] and the bitboards of passed pawns
+ * and the pawn attack span (every square that the pawns attack now or could
+ * attack after advancing) are returned through the entry.
+ *
+ * own:         A bitboard of the pawns of the side being evaluated.
+ * enemy:       A bitboard of the pawns of the other side.
+ * score:       The middlegame and endgame scores (indexed by phase).
+ * passed:      Filled with a bitboard of the passed pawns in 'own'.
+ * attackSpan:  Filled with the attack span of the pawns in 'own'.
+ */
+static void evaluatePawnStructure(uint64 own, uint64 enemy, int score[2],
+    uint64* passed, uint64* attackSpan) {
+    uint64 ownAttacks = ((own << 9) & ~FILE_A) | ((own << 7) & ~FILE_H);
+    uint64 enemyAttacks = ((enemy >> 9) & ~FILE_H) | ((enemy >> 7) & ~FILE_A);
+    *attackSpan = northFill(ownAttacks);
+
+    // A pawn is passed if there are no enemy pawns in front of it on the same
+    // file or on either adjacent file.
+    uint64 enemyFront = southFill((enemy | adjacentFiles(enemy)) >> 8);
+    *passed = own & ~enemyFront;
+
+    // A pawn is doubled if there is another pawn of the same color behind it,
+    // isolated if there are no pawns of the same color on the adjacent files,
+    // and backward if the square in front of it is attacked by an enemy pawn
+    // and no pawn of the same color can ever advance to defend it.
+    uint64 doubled = own & northFill(own << 8);
+    uint64 ownFiles = northFill(southFill(own));
+    uint64 isolated = own & ~adjacentFiles(ownFiles);
+    uint64 backward = ((own << 8) & enemyAttacks & ~*attackSpan) >> 8;
+    backward &= ~isolated;
+
+    uint64 passedPawns = *passed;
+    while (passedPawns) {
+        int rank = getLSB(passedPawns) / 8;
+        score[MIDDLEGAME] += passedBonus[MIDDLEGAME][rank];
+        score[ENDGAME] += passedBonus[ENDGAME][rank];
+        passedPawns &= passedPawns - 1;
+    }
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        score[phase] -= countBits(doubled) * doubledPenalty[phase];
+        score[phase] -= countBits(isolated) * isolatedPenalty[phase];
+        score[phase] -= countBits(backward) * backwardPenalty[phase];
+    }
+}
+
+/*
+ * Initialize the pawn hash table. Set pawnTable->numEntries to the correct
+ * value and allocate memory for the pawn entries. The number of entries is a
+ * power of 2 so that an index can be found with a mask instead of a modulo.
+ * If the memory can't be allocated the function prints an error message and
+ * returns 0.
+ *
+ * pawnTable:     The pawn table that is being initialized.
+ *
+ * return:        1 if the table was allocated, 0 otherwise.
+ */
+int initPawnTable(PawnTable* pawnTable) {
+    freePawnTable(pawnTable);
+    pawnTable->numEntries = PAWN_TABLE_SIZE / sizeof(PawnEntry);
+    assert((pawnTable->numEntries & (pawnTable->numEntries - 1)) == 0);
+    pawnTable->table = (PawnEntry*) malloc(PAWN_TABLE_SIZE);
+    if (pawnTable->table == NULL) {
+        puts("Error: initPawnTable: Could not allocate the pawn table.");
+        return 0;
+    }
+    clearPawnTable(pawnTable);
+    return 1;
+}
+
+/*
+ * Free the dynamically allocated block of memory pointed to by
+ * pawnTable->table. Any data stored in the pawn table will be lost.
+ *
+ * pawnTable:     The pawn table whose memory we are freeing.
+ */
+void freePawnTable(PawnTable* pawnTable) {
+    free(pawnTable->table);
+    pawnTable->table = NULL;
+}
+
+/*
+ * Delete all data from the pawn table. Note that an entry of all 0s is a
+ * valid entry: it is the entry for a board with no pawns (pawn key 0), which
+ * has no pawn structure terms.
+ *
+ * pawnTable:     The pawn table that is being cleared.
+ */
+void clearPawnTable(PawnTable* pawnTable) {
+    memset(pawnTable->table, 0, PAWN_TABLE_SIZE);
+}
+
+/*
+ * Retrieve the pawn structure evaluation of the given board from the board's
+ * pawn table. If the board's pawn structure is not in the table (the entry's
+ * pawn key does not match), evaluate it and overwrite the entry. Since the
+ * pawn structure changes rarely during a search, almost every call is a
+ * table hit.
+ *
+ * board:      The board whose pawn structure is evaluated. Passed in as a
+ *             const pointer which must not be NULL.
+ *
+ * return:     A pointer to the pawn table entry for the board's pawn key.
+ */
+const PawnEntry* probePawnTable(const Board* board) {
+    assert(board != NULL && board->pawnTable.table != NULL);
+    uint64 index = board->pawnKey & (board->pawnTable.numEntries - 1);
+    PawnEntry* entry = &board->pawnTable.table[index];
+    if (entry->pawnKey == board->pawnKey) {
+        return entry;
+    }
+    uint64 white = board->pieceBitboards[WHITE_PAWN];
+    uint64 black = board->pieceBitboards[BLACK_PAWN];
+    int whiteScore[2] = { 0, 0 }, blackScore[2] = { 0, 0 };
+    evaluatePawnStructure(white, black, whiteScore,
+        &entry->passed[WHITE], &entry->attackSpan[WHITE]);
+    evaluatePawnStructure(flipBitboard(black), flipBitboard(white), blackScore,
+        &entry->passed[BLACK], &entry->attackSpan[BLACK]);
+    entry->passed[BLACK] = flipBitboard(entry->passed[BLACK]);
+    entry->attackSpan[BLACK] = flipBitboard(entry->attackSpan[BLACK]);
+    entry->score[MIDDLEGAME] = whiteScore[MIDDLEGAME] - blackScore[MIDDLEGAME];
+    entry->score[ENDGAME] = whiteScore[ENDGAME] - blackScore[ENDGAME];
+    entry->pawnKey = board->pawnKey;
+    return entry;
+}
@@ -0,0 +1,205 @@
+#include "defs.h"
+
+#include <stdio.h>   // printf, puts, snprintf
+#include <string.h>  // memset
+
+#if defined(OS_LINUX)
+    #include <linux/perf_event.h>  // struct perf_event_attr, PERF_*
+    #include <sys/ioctl.h>         // ioctl
+    #include <sys/syscall.h>       // SYS_perf_event_open
+    #include <unistd.h>            // syscall, read, close
+#endif
+
+/*
+ * Count hardware events (cycles, instructions, branch misses, cache misses,
+ * and TLB misses) while a part of the program runs, using the Linux
+ * perf_event_open() system call. Dividing the counts by the number of nodes
+ * shows whether a slowdown comes from more work (instructions), from branch
+ * mispredictions, or from waiting on memory.
+ *
+ * Each counter is opened on its own, so a counter that the machine does not
+ * support (Ex: in a virtual machine) does not stop the others from being
+ * used. Counters only count user space code (the kernel usually does not
+ * allow more, see /proc/sys/kernel/perf_event_paranoid) and include threads
+ * that are created after the counters are opened (Ex: the perft threads).
+ *
+ * The counters are started and stopped around the code being measured and
+ * add up over every start/stop window. If there are more counters than the
+ * CPU has registers, the kernel takes turns counting them and the counts
+ * are scaled up to the whole time they were enabled.
+ *
+ * On other operating systems no counters are available.
+ */
+
+static const char* const counterNames[NUM_PERF_COUNTERS] = {
+    "cycles", "instructions", "branch misses", "L1d misses", "LLC misses",
+    "dTLB misses",
+};
+
+#if defined(OS_LINUX)
+
+/*
+ * Fill in the type and config of the given counter. The cache counters
+ * count read misses, which is what the engine's table lookups do.
+ */
+static void setCounterEvent(struct perf_event_attr* attr, int counter) {
+    const uint64 readMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr->type = PERF_TYPE_HW_CACHE;
+    switch (counter) {
+        case PERF_CYCLES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_BRANCH_MISSES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_L1D_MISSES:
+            attr->config = PERF_COUNT_HW_CACHE_L1D | readMiss;
+            break;
+        case PERF_LLC_MISSES:
+            attr->config = PERF_COUNT_HW_CACHE_LL | readMiss;
+            break;
+        default:
+            attr->config = PERF_COUNT_HW_CACHE_DTLB | readMiss;
+            break;
+    }
+}
+
+#endif
+
+/*
+ * Open every counter that the machine supports. The counters start out
+ * stopped at 0.
+ *
+ * counters:   The counters to be opened. Must not be NULL.
+ *
+ * return:     The number of counters that were opened. If it is 0, the
+ *             counters can still be used but will not count anything.
+ */
+int openPerfCounters(PerfCounters* counters) {
+    assert(counters != NULL);
+    memset(counters->values, 0, sizeof(counters->values));
+    int opened = 0;
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        counters->fds[i] = -1;
+#if defined(OS_LINUX)
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        setCounterEvent(&attr, i);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        counters->fds[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1,
+            -1, 0);
+        opened += counters->fds[i] >= 0;
+#endif
+    }
+    return opened;
+}
+
+/*
+ * Start counting. Counting continues from where the last stop left off.
+ */
+void startPerfCounters(PerfCounters* counters) {
+    assert(counters != NULL);
+#if defined(OS_LINUX)
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    (void) counters;
+#endif
+}
+
+/*
+ * Stop counting and update the values of the counters.
+ */
+void stopPerfCounters(PerfCounters* counters) {
+    assert(counters != NULL);
+#if defined(OS_LINUX)
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        // the value, the time enabled, and the time running
+        uint64 data[3];
+        if (counters->fds[i] < 0
+            || read(counters->fds[i], data, sizeof(data)) != sizeof(data)) {
+            continue;
+        }
+        counters->values[i] = data[2] == 0 ? 0 : data[2] >= data[1] ? data[0]
+            : (uint64) ((double) data[0] * data[1] / data[2]);
+    }
+#else
+    (void) counters;
+#endif
+}
+
+/*
+ * Print the value of every counter, in total and per node, and the
+ * instructions per cycle. Counters that could not be opened are marked as
+ * not supported.
+ *
+ * counters:   The counters to be printed. Must not be NULL.
+ * nodes:      The number of nodes that were searched while counting.
+ * unit:       The name of a node in the output (Ex: "node", "leaf").
+ */
+void printPerfCounters(const PerfCounters* counters, uint64 nodes,
+    const char* unit) {
+    assert(counters != NULL && unit != NULL);
+    int opened = 0;
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        opened += counters->fds[i] >= 0;
+    }
+    if (opened == 0) {
+        puts("Performance counters: not available");
+        return;
+    }
+    char perUnit[32];
+    snprintf(perUnit, sizeof(perUnit), "per %s", unit);
+    printf("%-14s %16s %16s\n", "counter", "total", perUnit);
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        if (counters->fds[i] < 0) {
+            printf("%-14s %16s\n", counterNames[i], "not supported");
+        } else {
+            uint64 value = counters->values[i];
+            printf("%-14s %16llu %16.3f\n", counterNames[i], value,
+                nodes == 0 ? 0.0 : (double) value / nodes);
+        }
+    }
+    if (counters->fds[PERF_CYCLES] >= 0
+        && counters->fds[PERF_INSTRUCTIONS] >= 0
+        && counters->values[PERF_CYCLES] != 0) {
+        printf("%-14s %16.3f\n", "IPC", (double) counters->values[
+            PERF_INSTRUCTIONS] / counters->values[PERF_CYCLES]);
+    }
+}
+
+/*
+ * Close the counters.
+ */
+void closePerfCounters(PerfCounters* counters) {
+    assert(counters != NULL);
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+#if defined(OS_LINUX)
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+        }
+#endif
+        counters->fds[i] = -1;
+    }
+}
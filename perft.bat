@@ -6,7 +6,7 @@ del perft.exe
 echo Compiling chess engine...
 
 set warnings=-Wall -Wextra -Wpedantic -Werror
-set c_files=defs.c board.c movegen.c attack.c magic.c hashkey.c hashtable.c libs\tinycthread.c
+set c_files=defs.c board.c movegen.c attack.c magic.c hashkey.c hashtable.c evaluate.c pawns.c material.c nnue.c batcheval.c epd.c pgn.c perfcounters.c profiler.c libs\tinycthread.c
 
 gcc perft.c %c_files% -O3 %warnings% -DNDEBUG -o perft.exe
 
@@ -1,18 +1,23 @@
 #include "defs.h"
 
 #include <stdio.h>   // printf, puts, scanf, scanf_s, fflush
-#include <string.h>  // memset, memcpy
+#include <stdlib.h>  // atoi
+#include <string.h>  // memset, memcpy, strcspn, strcmp
 
 // If the user defines PERFT_MULTITHREADED in the command line, use the
-// library tinycthread for multithreading.
-#define PERFT_MULTITHREADED
+// library tinycthread for multithreading. It is on by default.
+#ifndef PERFT_MULTITHREADED
+    #define PERFT_MULTITHREADED
+#endif
 #ifdef PERFT_MULTITHREADED
-    #include "libs\tinycthread.h"
+    #include "libs/tinycthread.h"
 #endif
 
-#define NUM_TESTS 134
+// The deepest depth that a perft test can have a solution for.
+#define MAX_PERFT_DEPTH 9
 
-static const char* PERFT_FENS[NUM_TESTS] = {
+// The built-in tests, used when no EPD file is given on the command line.
+static const char* PERFT_FENS[] = {
     "3qk3/3pp3/8/8/8/8/3PP3/3QK3 b - - 0 1",
     "2nrkrn1/3ppp2/8/8/8/8/3PPP2/2NRKRN1 w - - 0 1",
     "3n4/5n2/3k4/6N1/3N4/4K3/8/8 w - - 0 1",
@@ -149,7 +154,9 @@ static const char* PERFT_FENS[NUM_TESTS] = {
     "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
 };
 
-static const uint64 PERFT_SOLUTIONS[NUM_TESTS][10] = {
+#define NUM_TESTS ((int) (sizeof(PERFT_FENS) / sizeof(PERFT_FENS[0])))
+
+static const uint64 PERFT_SOLUTIONS[][MAX_PERFT_DEPTH + 1] = {
     { 1, 12,  141,  2758,   50760,   1082533,   22240577,    483413686,  10267317439, 222539743521 },
     { 1, 11,  121,  1629,   21883,    350790,    5604562,    102904738,   1877173820,  38354094602 },
     { 1, 21,  238,  4497,   58352,   1037254,   14314799,    242652292,   3473255783,  57193406492 },
@@ -286,13 +293,20 @@ static const uint64 PERFT_SOLUTIONS[NUM_TESTS][10] = {
     { 1, 24,  496,  9483,  182838,   3605103,   71179139,   1482218224,  30927558887,            0 },
 };
 
-static uint64 curTestResult[10];
+static uint64 curTestResult[MAX_PERFT_DEPTH + 1];
+static uint64 totalLeafNodes;
+static uint64 totalTime;
+
+// the hardware counters, if -counters is given (see perfcounters.c)
+static int useCounters;
+static PerfCounters counters;
 
 #ifdef PERFT_MULTITHREADED
 
-#define MAX_THREADS 128
+// one thread per root move, and a position can have more than 200 moves
+#define MAX_THREADS 256
 
-static uint64 threadSolutions[MAX_THREADS][10];
+static uint64 threadSolutions[MAX_THREADS][MAX_PERFT_DEPTH + 1];
 static thrd_t threads[MAX_THREADS];
 static int threadArg[MAX_THREADS];
 static Board boards[MAX_THREADS];
@@ -315,19 +329,22 @@ static void perftMultithreaded(int depth, const int threadIndex) {
 
 static int threadStart(void* args) {
     const int threadIndex = ((int*) args)[0];
+    startPhaseProfile();
     perftMultithreaded(1, threadIndex);
+    stopPhaseProfile();
     return 0;
 }
 
 static void perft(const Board* board, int depth, int maxDepth) {
     memset(threadSolutions, 0, sizeof(threadSolutions));
-    for (int i = 0; i < MAX_THREADS; ++i) {
-        memcpy(&boards[i], board, sizeof(Board));
-    }
     int created[MAX_THREADS] = { 0 };
     maxDepthMT = maxDepth;
     MoveList list; 
     generateAllMoves(board, &list);
+    assert(list.numMoves <= MAX_THREADS);
+    for (int i = 0; i < list.numMoves; ++i) {
+        memcpy(&boards[i], board, sizeof(Board));
+    }
     for (int i = 0; i < list.numMoves; ++i) {
         if (makeMove(&boards[i], list.moves[i])) {
             created[i] = 1;
@@ -373,47 +390,67 @@ static void perft(Board* board, int depth, int maxDepth) {
 
 #endif
 
-static int findMaxDepth(int test, int maxDepth) {
-    int depth = 9;
-    while (PERFT_SOLUTIONS[test][depth] == 0) {
+/*
+ * Find the depth to run a test to: the deepest depth with a solution, but no
+ * deeper than maxDepth.
+ */
+static int findMaxDepth(const uint64* solutions, int maxDepth) {
+    int depth = MAX_PERFT_DEPTH;
+    while (depth > 0 && solutions[depth] == 0) {
         --depth;
     }
     return depth < maxDepth ? depth : maxDepth;
 }
 
-static void perftTest(int maxDepth) {
-    uint64 totalLeafNodes = 0;
-    uint64 totalTime = 0;
-    int numPassed = 0;
-    for (int test = 0; test < NUM_TESTS; ++test) {
-        puts("----------------------------------------------------------------------------------------");
-        printf("%d) FEN: \"%s\"\n", test + 1, PERFT_FENS[test]);
-        Board board;
-        if (!setBoardToFen(&board, PERFT_FENS[test])) {
-            puts("ERROR: Invalid FEN");
-            return;
-        }
-        memset(curTestResult, 0, sizeof(curTestResult));
-        int maxTestDepth = findMaxDepth(test, maxDepth);
-        uint64 startTime = getTime();
-        perft(&board, 0, maxTestDepth);
-        uint64 elapsedTime = getTime() - startTime;
-        int passed = 1;
-        for (int depth = 1; depth <= maxTestDepth; ++depth) {
+/*
+ * Run perft on the board and compare the number of leaf nodes at each depth
+ * with solutions[]. Depths without a solution (0) are not checked. If
+ * verbose is set, the result of each depth is printed. The leaf nodes and
+ * time are added to the totals. Return 1 if every depth passed, 0 otherwise.
+ */
+static int runPerft(Board* board, const uint64* solutions, int maxDepth,
+    int verbose) {
+    memset(curTestResult, 0, sizeof(curTestResult));
+    int maxTestDepth = findMaxDepth(solutions, maxDepth);
+    uint64 startTime = getTime();
+    if (useCounters) {
+        startPerfCounters(&counters);
+    }
+#ifdef PERFT_MULTITHREADED
+    // each perft thread profiles itself, so the wait for them is left out
+    perft(board, 0, maxTestDepth);
+#else
+    startPhaseProfile();
+    perft(board, 0, maxTestDepth);
+    stopPhaseProfile();
+#endif
+    if (useCounters) {
+        stopPerfCounters(&counters);
+    }
+    uint64 elapsedTime = getTime() - startTime;
+    int passed = 1;
+    for (int depth = 1; depth <= maxTestDepth; ++depth) {
+        int correct = solutions[depth] == 0
+            || curTestResult[depth] == solutions[depth];
+        if (verbose) {
             printf("depth: %d | test result: %13llu | ", depth, curTestResult[depth]);
-            if (curTestResult[depth] == PERFT_SOLUTIONS[test][depth]) {
+            if (correct) {
                 puts("passed");
             } else {
-                printf("----FAILED---- answer: %lld\n", PERFT_SOLUTIONS[test][depth]);
-                passed = 0;
+                printf("----FAILED---- answer: %lld\n", solutions[depth]);
             }
         }
-        totalLeafNodes += curTestResult[maxTestDepth];
-        numPassed += passed;
+        passed &= correct;
+    }
+    totalLeafNodes += curTestResult[maxTestDepth];
+    totalTime += elapsedTime;
+    if (verbose) {
         printf("total time: %lld ms\n", elapsedTime);
-        totalTime += elapsedTime;
-        freeHashTable(&board.pvTable);
     }
+    return passed;
+}
+
+static void printSummary(int numPassed, int numTests) {
     puts("----------------------------------------------------------------------------------------");
     if (totalTime == 0) {
         printf("This engine visited %lld leaf nodes in < 1 millisecond.\n", totalLeafNodes);
@@ -422,11 +459,76 @@ static void perftTest(int maxDepth) {
         printf("This engine visited %lld leaf nodes in %lld milliseconds.\n", totalLeafNodes, totalTime);
         printf("Average: %lld Leaf Nodes / Second\n", totalLeafNodes * 1000 / totalTime);
     }
-    printf("Passed: %d / %d\n", numPassed, NUM_TESTS);
+    printf("Passed: %d / %d\n", numPassed, numTests);
+    if (useCounters) {
+        printPerfCounters(&counters, totalLeafNodes, "leaf");
+    }
+    printPhaseProfile(totalLeafNodes, "leaf");
     fflush(stdout);
 }
 
-int main() {
+static void perftTest(int maxDepth) {
+    int numPassed = 0;
+    // perft only generates and makes moves, so the board doesn't need tables
+    static Board board;
+    for (int test = 0; test < NUM_TESTS; ++test) {
+        puts("----------------------------------------------------------------------------------------");
+        printf("%d) FEN: \"%s\"\n", test + 1, PERFT_FENS[test]);
+        if (!setBoardToFen(&board, PERFT_FENS[test])) {
+            puts("ERROR: Invalid FEN");
+            return;
+        }
+        numPassed += runPerft(&board, PERFT_SOLUTIONS[test], maxDepth, 1);
+    }
+    printSummary(numPassed, NUM_TESTS);
+}
+
+/*
+ * Run the perft tests in an EPD file, one position per line with its
+ * solutions given as ";D1 n ;D2 n ..." operations (see epd.c). Empty lines and
+ * lines starting with '#' are skipped. The file is streamed straight into
+ * the perft driver, so only failed tests are printed, followed by the same
+ * summary as the built-in tests.
+ */
+static void perftFile(const char* path, int maxDepth) {
+    EpdFile file;
+    if (!openEpdFile(&file, path)) {
+        return;
+    }
+    static Board board;
+    uint64 solutions[MAX_PERFT_DEPTH + 1];
+    int numTests = 0, numPassed = 0;
+    for (const char* line; (line = nextEpdLine(&file)) != NULL; ) {
+        if (line[0] == '\n' || line[0] == '\r' || line[0] == '\0'
+            || line[0] == '#') {
+            continue;
+        }
+        ++numTests;
+        int lineLength = (int) strcspn(line, "\r\n");
+        if (parsePerftCounts(line, solutions, MAX_PERFT_DEPTH) == 0
+            || !setBoardToFen(&board, line)) {
+            printf("%d) ERROR: Invalid EPD line: \"%.*s\"\n", numTests,
+                lineLength, line);
+        } else if (runPerft(&board, solutions, maxDepth, 0)) {
+            ++numPassed;
+        } else {
+            printf("%d) ----FAILED---- EPD: \"%.*s\"\n", numTests, lineLength,
+                line);
+        }
+    }
+    closeEpdFile(&file);
+    printSummary(numPassed, numTests);
+}
+
+/*
+ * Usage: perft [-counters] [max depth] [tests.epd]
+ *
+ * Without arguments the max depth is read from the input and the built-in
+ * tests are run. If an EPD file is given, its tests are run instead. With
+ * -counters, the hardware performance counters of the perft runs are
+ * printed at the end, in total and per leaf node.
+ */
+int main(int argc, char** argv) {
     puts("---------------------------");
 
 #if defined(OS_WINDOWS)
@@ -450,16 +552,38 @@ int main() {
     puts("---------------------------");
     
     initializeAll();
-    printf("Enter the max search depth for the perft tests (3-5 recommended): ");
+    if (argc > 1 && strcmp(argv[1], "-counters") == 0) {
+        useCounters = 1;
+        if (openPerfCounters(&counters) == 0) {
+            puts("Performance counters are not available.");
+        }
+        --argc;
+        ++argv;
+    }
     int maxDepth;
+    if (argc > 1) {
+        maxDepth = atoi(argv[1]);
+    } else {
+        printf("Enter the max search depth for the perft tests (3-5 recommended): ");
 #if defined(COMPILER_MSVS)
-    if (scanf_s("%d", &maxDepth) != 1 || maxDepth < 1) {
+        if (scanf_s("%d", &maxDepth) != 1) {
 #else
-    if (scanf("%d", &maxDepth) != 1 || maxDepth < 1) {
+        if (scanf("%d", &maxDepth) != 1) {
 #endif
+            maxDepth = 0;
+        }
+    }
+    if (maxDepth < 1) {
         puts("Invalid Input. Enter a number > 0.");
         return -1;
     }
-    perftTest(maxDepth);
+    if (argc > 2) {
+        perftFile(argv[2], maxDepth);
+    } else {
+        perftTest(maxDepth);
+    }
+    if (useCounters) {
+        closePerfCounters(&counters);
+    }
     return 0;
 }
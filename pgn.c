@@ -0,0 +1,522 @@
+#include "defs.h"
+
+#include <stdio.h>   // puts
+#include <string.h>  // memcmp, memcpy, strlen
+
+/*
+ * Read games from PGN (Portable Game Notation) files. A PGN game is a
+ * section of tag pairs followed by the movetext:
+ *
+ *     [Event "Paris"]
+ *     [Result "1-0"]
+ *
+ *     1. e4 e5 2. Nf3 d6 3. d4 Bg4 {comment} 4. dxe5 (4. c3) Bxf3 ... 1-0
+ *
+ * The file is mapped into memory (see mapReadOnlyFile() in epd.c) and read
+ * in a single pass: readPgnHeaders() reads the tag pairs of the next game and
+ * readPgnMove() reads the moves one at a time, skipping move numbers,
+ * comments, NAGs ($1), and variations. Nothing is copied except the FEN tag.
+ *
+ * The moves are in SAN (Standard Algebraic Notation), Ex: "Nbd7", "exd5",
+ * "e8=Q+", "O-O". parseSan() finds the move from the destination square by
+ * looking up which pieces of the right type attack it, the same way
+ * squareAttacked() does, instead of generating every move and comparing
+ * strings.
+ */
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+// the kinds of token returned by nextToken()
+enum { PGN_MOVE, PGN_GAME_END, PGN_NEXT_GAME, PGN_FILE_END };
+
+/*
+ * Open a PGN file for reading with readPgnHeaders() and readPgnMove(). If
+ * something goes wrong the function prints an error message and returns 0.
+ *
+ * file:       The PgnFile to be opened. Must not be NULL.
+ * path:       The path of the file. Must not be NULL.
+ *
+ * return:     1 if the file was opened, 0 otherwise.
+ */
+int openPgnFile(PgnFile* file, const char* path) {
+    assert(file != NULL && path != NULL);
+    if (!mapReadOnlyFile(path, &file->data, &file->size)) {
+        puts("Error: openPgnFile: Could not open or map the file.");
+        return 0;
+    }
+    file->position = file->data;
+    file->end = file->data + file->size;
+    file->inGame = 0;
+    return 1;
+}
+
+/*
+ * Unmap the file.
+ *
+ * file:       The file to be closed. Must not be NULL.
+ */
+void closePgnFile(PgnFile* file) {
+    assert(file != NULL);
+    unmapReadOnlyFile(file->data, file->size);
+    file->data = file->position = file->end = NULL;
+    file->size = 0;
+    file->inGame = 0;
+}
+
+/*
+ * Return a pointer to the character after the first 'stop' character after
+ * c, or 'end' if there is none.
+ */
+static const char* skipPast(const char* c, const char* end, char stop) {
+    for (++c; c < end; ++c) {
+        if (*c == stop) {
+            return c + 1;
+        }
+    }
+    return end;
+}
+
+/*
+ * Skip a variation, which starts at the '(' at c. Variations can be nested
+ * and can contain comments (which can contain parentheses).
+ */
+static const char* skipVariation(const char* c, const char* end) {
+    int depth = 0;
+    while (c < end) {
+        if (*c == '{') {
+            c = skipPast(c, end, '}');
+            continue;
+        }
+        depth += (*c == '(') - (*c == ')');
+        ++c;
+        if (depth == 0) {
+            break;
+        }
+    }
+    return c;
+}
+
+/*
+ * Check if the character ends a word of movetext.
+ */
+static int isDelimiter(char c) {
+    switch (c) {
+        case ' ': case '\t': case '\r': case '\n':
+        case '{': case '(': case ')': case ';': case '[': case '$':
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Read the next token of movetext. Move numbers, comments, NAGs, and
+ * variations are skipped. A SAN move is stored in 'token' and 'length' and
+ * returns PGN_MOVE. A game termination marker (1-0, 0-1, 1/2-1/2, *) returns
+ * PGN_GAME_END. The '[' of the next game's tag pairs returns PGN_NEXT_GAME and
+ * is not consumed. The end of the part being read returns PGN_FILE_END.
+ */
+static int nextToken(PgnFile* file, const char** token, int* length) {
+    const char* c = file->position;
+    const char* end = file->end;
+    while (c < end) {
+        switch (*c) {
+            case ' ': case '\t': case '\r': case '\n': case ')':
+                ++c;
+                continue;
+            case '{':
+                c = skipPast(c, end, '}');
+                continue;
+            case ';':
+                c = skipPast(c, end, '\n');
+                continue;
+            case '(':
+                c = skipVariation(c, end);
+                continue;
+            case '$':
+                for (++c; c < end && *c >= '0' && *c <= '9'; ++c);
+                continue;
+            case '[':
+                file->position = c;
+                return PGN_NEXT_GAME;
+            case '*':
+                file->position = c + 1;
+                return PGN_GAME_END;
+        }
+        const char* start = c;
+        while (c < end && !isDelimiter(*c)) {
+            ++c;
+        }
+        int wordLength = (int) (c - start);
+        if ((wordLength == 3 && (memcmp(start, "1-0", 3) == 0
+            || memcmp(start, "0-1", 3) == 0))
+            || (wordLength == 7 && memcmp(start, "1/2-1/2", 7) == 0)) {
+            file->position = c;
+            return PGN_GAME_END;
+        }
+        // a move number ("12." or "12...") possibly followed by a move
+        if (*start >= '1' && *start <= '9') {
+            while (start < c && ((*start >= '0' && *start <= '9')
+                || *start == '.')) {
+                ++start;
+            }
+            if (start == c) {
+                continue;
+            }
+        }
+        file->position = c;
+        *token = start;
+        *length = (int) (c - start);
+        return PGN_MOVE;
+    }
+    file->position = end;
+    return PGN_FILE_END;
+}
+
+/*
+ * Parse the tag pair at c, which starts with '['. The tag name and value
+ * (without the quotes) are stored in the output parameters. Return a pointer
+ * to the character after the closing ']', or NULL if the tag pair is not
+ * valid.
+ */
+static const char* parseTag(const char* c, const char* end, const char** name,
+    int* nameLength, const char** value, int* valueLength) {
+    for (++c; c < end && *c == ' '; ++c);
+    *name = c;
+    while (c < end && *c != ' ' && *c != '"' && *c != ']' && *c != '\n') {
+        ++c;
+    }
+    *nameLength = (int) (c - *name);
+    while (c < end && *c == ' ') {
+        ++c;
+    }
+    if (c == end || *c != '"') {
+        return NULL;
+    }
+    *value = ++c;
+    while (c < end && *c != '"' && *c != '\n') {
+        c += (*c == '\\' && c + 1 < end) ? 2 : 1;
+    }
+    if (c >= end || *c != '"') {
+        return NULL;
+    }
+    *valueLength = (int) (c - *value);
+    for (++c; c < end && *c == ' '; ++c);
+    return c < end && *c == ']' ? c + 1 : NULL;
+}
+
+/*
+ * Find the result of a game from the value of its Result tag.
+ */
+static int parseResult(const char* value, int length) {
+    if (length == 3 && memcmp(value, "1-0", 3) == 0) {
+        return 2;
+    }
+    if (length == 3 && memcmp(value, "0-1", 3) == 0) {
+        return 0;
+    }
+    if (length == 7 && memcmp(value, "1/2-1/2", 7) == 0) {
+        return 1;
+    }
+    return PACKED_NO_RESULT;
+}
+
+/*
+ * Read the tag pairs of the next game. Whatever is left of the moves of the
+ * previous game is skipped. Afterwards the game's moves can be read with
+ * readPgnMove(). A game without any tag pairs is read as a game from the
+ * starting position with an unknown result.
+ *
+ * file:       The file being read. Must have been opened with openPgnFile().
+ * game:       Set to the tag pairs of the game. Must not be NULL.
+ *
+ * return:     1 if a game was found, 0 if there are no games left.
+ */
+int readPgnHeaders(PgnFile* file, PgnGame* game) {
+    assert(file != NULL && game != NULL);
+    const char* token;
+    int length;
+    while (file->inGame) {
+        if (nextToken(file, &token, &length) != PGN_MOVE) {
+            file->inGame = 0;
+        }
+    }
+    const char* c = file->position;
+    const char* end = file->end;
+    while (c < end && (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n')) {
+        ++c;
+    }
+    if (c == end) {
+        file->position = end;
+        return 0;
+    }
+    game->tags = c;
+    game->fen[0] = '\0';
+    game->result = PACKED_NO_RESULT;
+    while (c < end && *c == '[') {
+        const char* name;
+        const char* value;
+        int nameLength, valueLength;
+        const char* next = parseTag(c, end, &name, &nameLength, &value,
+            &valueLength);
+        if (next == NULL) {
+            // skip the rest of the line
+            next = skipPast(c, end, '\n');
+        } else if (nameLength == 6 && memcmp(name, "Result", 6) == 0) {
+            game->result = parseResult(value, valueLength);
+        } else if (nameLength == 3 && memcmp(name, "FEN", 3) == 0
+            && valueLength < MAX_FEN_LENGTH) {
+            memcpy(game->fen, value, valueLength);
+            game->fen[valueLength] = '\0';
+        }
+        c = next;
+        while (c < end && (*c == ' ' || *c == '\t' || *c == '\r'
+            || *c == '\n')) {
+            ++c;
+        }
+    }
+    game->tagsLength = (int) (c - game->tags);
+    file->position = c;
+    file->inGame = 1;
+    return 1;
+}
+
+/*
+ * Find the value of a tag of the game, Ex: findPgnTag(game, "WhiteElo", &n).
+ * The value is not NUL-terminated.
+ *
+ * game:       The game whose tags are searched. Must not be NULL.
+ * name:       The name of the tag. Must not be NULL.
+ * length:     Set to the length of the value.
+ *
+ * return:     A pointer to the value in the file, or NULL if the game does
+ *             not have the tag.
+ */
+const char* findPgnTag(const PgnGame* game, const char* name, int* length) {
+    assert(game != NULL && name != NULL && length != NULL);
+    int targetLength = (int) strlen(name);
+    const char* c = game->tags;
+    const char* end = game->tags + game->tagsLength;
+    while (c < end) {
+        const char* tagName;
+        const char* value;
+        int nameLength, valueLength;
+        const char* next = *c == '[' ? parseTag(c, end, &tagName, &nameLength,
+            &value, &valueLength) : NULL;
+        if (next == NULL) {
+            c = skipPast(c, end, '\n');
+            continue;
+        }
+        if (nameLength == targetLength
+            && memcmp(tagName, name, targetLength) == 0) {
+            *length = valueLength;
+            return value;
+        }
+        for (c = next; c < end && *c != '['; ++c);
+    }
+    return NULL;
+}
+
+/*
+ * Set up the board to the starting position of the game: the position of its
+ * FEN tag, or the standard starting position. Like setBoardToFen(), the
+ * board's tables are kept.
+ *
+ * board:      The board to be set up. Must not be NULL.
+ * game:       The game read by readPgnHeaders(). Must not be NULL.
+ *
+ * return:     1 if the board was set up, 0 if the FEN tag is not valid.
+ */
+int startPgnGame(Board* board, const PgnGame* game) {
+    assert(board != NULL && game != NULL);
+    return setBoardToFen(board, game->fen[0] != '\0' ? game->fen : START_FEN);
+}
+
+/*
+ * Read the next move of the game and find it on the board. The move is not
+ * made: the caller makes it with makeMove(), which also checks that it does
+ * not leave the king in check. Errors are not printed, since large databases
+ * usually have a few broken games that are simply skipped.
+ *
+ * file:       The file being read. readPgnHeaders() must have been called.
+ * board:      The board with the game's current position. Must not be NULL.
+ *
+ * return:     The move, 0 if the game has no moves left, or -1 if the next
+ *             move is not valid SAN in the position or the game is too long
+ *             for the board's history. The rest of the game is skipped by
+ *             the next call to readPgnHeaders().
+ */
+int readPgnMove(PgnFile* file, Board* board) {
+    assert(file != NULL && board != NULL);
+    if (!file->inGame) {
+        return 0;
+    }
+    const char* token;
+    int length;
+    if (nextToken(file, &token, &length) != PGN_MOVE) {
+        file->inGame = 0;
+        return 0;
+    }
+    if (board->ply >= MAX_GAME_MOVES - 1) {
+        return -1;
+    }
+    int move = parseSan(board, token, length);
+    return move != 0 ? move : -1;
+}
+
+/*
+ * Find the piece type of a SAN piece letter, or -1 if the letter is not a
+ * piece letter.
+ */
+static int pieceType(char letter) {
+    switch (letter) {
+        case 'N': return KNIGHT;
+        case 'B': return BISHOP;
+        case 'R': return ROOK;
+        case 'Q': return QUEEN;
+        case 'K': return KING;
+        default: return -1;
+    }
+}
+
+/*
+ * Find the move written in SAN on the board. The destination square is read
+ * from the end of the move, and the pieces that could have moved there are
+ * the pieces of the right type that attack it (a piece on 'to' attacks
+ * 'from' exactly when a piece on 'from' attacks 'to'), narrowed down by the
+ * file and rank hints (Ex: the 'b' in "Nbd7"). Only if more than one piece
+ * is left (one of them must be pinned) are the moves tried on the board.
+ * Long algebraic moves with a from square (Ex: "Ng1f3", "Ng1-f3") are
+ * accepted too, since the from square is just a file and a rank hint.
+ *
+ * board:      The board the move is played on. Must not be NULL. It is only
+ *             changed while a move is tried and is restored afterwards.
+ * san:        The move. Does not need to be NUL-terminated.
+ * length:     The length of the move.
+ *
+ * return:     The move, or 0 if it is not valid in the position.
+ */
+int parseSan(Board* board, const char* san, int length) {
+    assert(board != NULL && san != NULL);
+    while (length > 0 && (san[length - 1] == '+' || san[length - 1] == '#'
+        || san[length - 1] == '!' || san[length - 1] == '?')) {
+        --length;
+    }
+    int side = board->sideToMove;
+    if (length >= 3 && (san[0] == 'O' || san[0] == '0')) {
+        int from = side == WHITE ? E1 : E8;
+        int to;
+        if (length == 3 && san[1] == '-' && san[2] == san[0]) {
+            to = from + 2;
+        } else if (length == 5 && san[1] == '-' && san[2] == san[0]
+            && san[3] == '-' && san[4] == san[0]) {
+            to = from - 2;
+        } else {
+            return 0;
+        }
+        if (board->pieces[from] != pieces[side][KING]) {
+            return 0;
+        }
+        // castling has conditions that makeMove() does not check
+        int move = buildMove(board, from, to, NO_PIECE);
+        return moveExists(board, move) ? move : 0;
+    }
+
+    int type = pieceType(san[0]);
+    int start = type < 0 ? 0 : 1;
+    type = type < 0 ? PAWN : type;
+    int promoted = NO_PIECE;
+    if (type == PAWN && length >= 3 && pieceType(san[length - 1]) > PAWN
+        && pieceType(san[length - 1]) < KING) {
+        promoted = pieces[side][pieceType(san[length - 1])];
+        length -= san[length - 2] == '=' ? 2 : 1;
+    }
+    if (length - start < 2) {
+        return 0;
+    }
+    int toFile = san[length - 2] - 'a', toRank = san[length - 1] - '1';
+    if (toFile < 0 || toFile > 7 || toRank < 0 || toRank > 7) {
+        return 0;
+    }
+    int to = toRank * 8 + toFile;
+    uint64 target = 1ULL << to;
+    if (board->colorBitboards[side] & target) {
+        return 0;
+    }
+    uint64 fromMask = ~0ULL;
+    int fromFile = -1;
+    for (int i = start; i < length - 2; ++i) {
+        if (san[i] >= 'a' && san[i] <= 'h') {
+            fromFile = san[i] - 'a';
+            fromMask &= FILE_A << fromFile;
+        } else if (san[i] >= '1' && san[i] <= '8') {
+            fromMask &= 0xFFULL << (8 * (san[i] - '1'));
+        } else if (san[i] != 'x' && san[i] != '-') {
+            return 0;
+        }
+    }
+
+    uint64 own = board->pieceBitboards[pieces[side][type]] & fromMask;
+    uint64 allPieces = board->colorBitboards[BOTH_COLORS];
+    uint64 candidates;
+    switch (type) {
+        case PAWN: {
+            int forward = side == WHITE ? 8 : -8;
+            int relativeRank = side == WHITE ? toRank : 7 - toRank;
+            if (relativeRank < 2
+                || (relativeRank == 7) != (promoted != NO_PIECE)) {
+                return 0;
+            }
+            if (fromFile >= 0 && fromFile != toFile) {
+                // a capture: the pawn is on the given file, one rank back
+                if (fromFile - toFile != 1 && toFile - fromFile != 1) {
+                    return 0;
+                }
+                if (!(board->colorBitboards[!side] & target)
+                    && board->enPassantSquare != target) {
+                    return 0;
+                }
+                candidates = own & (1ULL << (to - forward + fromFile - toFile));
+            } else if (allPieces & target) {
+                return 0;
+            } else if (own & (1ULL << (to - forward))) {
+                candidates = 1ULL << (to - forward);
+            } else if (toRank == (side == WHITE ? 3 : 4)
+                && !(allPieces & (1ULL << (to - forward)))) {
+                candidates = own & (1ULL << (to - 2 * forward));
+            } else {
+                candidates = 0ULL;
+            }
+            break;
+        }
+        // the sliding attack functions expect a piece on the square
+        case KNIGHT: candidates = own & getKnightAttacks(to); break;
+        case BISHOP:
+            candidates = own & getBishopAttacks(to, allPieces | target);
+            break;
+        case ROOK:
+            candidates = own & getRookAttacks(to, allPieces | target);
+            break;
+        case QUEEN:
+            candidates = own & getQueenAttacks(to, allPieces | target);
+            break;
+        default: candidates = own & getKingAttacks(target); break;
+    }
+    if (candidates == 0ULL) {
+        return 0;
+    }
+    if ((candidates & (candidates - 1)) == 0ULL) {
+        return buildMove(board, getLSB(candidates), to, promoted);
+    }
+    int found = 0;
+    for (; candidates; candidates &= candidates - 1) {
+        int move = buildMove(board, getLSB(candidates), to, promoted);
+        if (makeMove(board, move)) {
+            undoMove(board);
+            if (found != 0) {
+                return 0;
+            }
+            found = move;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,109 @@
+#include "defs.h"
+
+#include <stdio.h>   // printf, puts, snprintf
+#include <string.h>  // memset
+
+/*
+ * Count the CPU cycles spent in each phase of the engine (move generation,
+ * sorting the moves, making and undoing moves, legality checks, the
+ * evaluation, and the hash tables), to see where the time of a search or a
+ * perft run goes. The phases are timed with the time stamp counter (rdtsc)
+ * by the PROFILE_* macros in defs.h, which are only compiled in with
+ * -D PHASE_PROFILER.
+ *
+ * Each thread counts its own cycles in phaseProfile, so the threads do not
+ * share any cache lines while they run. startPhaseProfile() clears the
+ * counts of the current thread, and stopPhaseProfile() adds them to the
+ * totals of all threads, which printPhaseProfile() prints and clears. The
+ * time stamp counter keeps running while a thread is not, so with more
+ * threads than processors (Ex: the multithreaded perft) the shares are those
+ * of the elapsed time of every thread, not of the time that it ran.
+ *
+ * Reading the time stamp counter takes some cycles itself, which are added
+ * to the phases being timed (most of all to the short ones, like the
+ * legality checks). The shares are meant for comparing profiled builds with
+ * each other, not for comparing with the speed of a normal build.
+ */
+
+#if defined(PHASE_PROFILER)
+
+_Thread_local PhaseProfile phaseProfile;
+
+static const char* const phaseNames[NUM_PROFILE_PHASES] = {
+    "other", "move generation", "sorting", "make/undo", "legality",
+    "evaluation", "hash tables",
+};
+
+static uint64 totalCycles[NUM_PROFILE_PHASES];
+static mtx_t totalsMutex;
+static once_flag totalsOnce = ONCE_FLAG_INIT;
+
+static void initTotalsMutex() {
+    mtx_init(&totalsMutex, mtx_plain);
+}
+
+#endif
+
+/*
+ * Clear the counts of the current thread and start timing it in
+ * PHASE_OTHER.
+ */
+void startPhaseProfile() {
+#if defined(PHASE_PROFILER)
+    memset(&phaseProfile, 0, sizeof(phaseProfile));
+    phaseProfile.phase = PHASE_OTHER;
+    phaseProfile.last = __rdtsc();
+#endif
+}
+
+/*
+ * Stop timing the current thread and add its counts to the totals. May be
+ * called by several threads at once.
+ */
+void stopPhaseProfile() {
+#if defined(PHASE_PROFILER)
+    switchProfilePhase(PHASE_OTHER);
+    call_once(&totalsOnce, initTotalsMutex);
+    mtx_lock(&totalsMutex);
+    for (int i = 0; i < NUM_PROFILE_PHASES; ++i) {
+        totalCycles[i] += phaseProfile.cycles[i];
+    }
+    mtx_unlock(&totalsMutex);
+#endif
+}
+
+/*
+ * Print the total cycles of each phase, their share of all the cycles, and
+ * the cycles per node, then clear the totals. Prints nothing if the
+ * profiler is not compiled in.
+ *
+ * nodes:      The number of nodes that were searched while profiling.
+ * unit:       The name of a node in the output (Ex: "node", "leaf").
+ */
+void printPhaseProfile(uint64 nodes, const char* unit) {
+    assert(unit != NULL);
+#if defined(PHASE_PROFILER)
+    uint64 sum = 0;
+    for (int i = 0; i < NUM_PROFILE_PHASES; ++i) {
+        sum += totalCycles[i];
+    }
+    if (sum == 0) {
+        puts("Phase profile: no cycles were counted");
+        return;
+    }
+    char perUnit[32];
+    snprintf(perUnit, sizeof(perUnit), "per %s", unit);
+    printf("%-16s %16s %8s %12s\n", "phase", "cycles", "share", perUnit);
+    for (int i = 0; i < NUM_PROFILE_PHASES; ++i) {
+        printf("%-16s %16llu %7.2f%% %12.1f\n", phaseNames[i], totalCycles[i],
+            100.0 * totalCycles[i] / sum,
+            nodes == 0 ? 0.0 : (double) totalCycles[i] / nodes);
+    }
+    printf("%-16s %16llu %7.2f%% %12.1f\n", "total", sum, 100.0,
+        nodes == 0 ? 0.0 : (double) sum / nodes);
+    memset(totalCycles, 0, sizeof(totalCycles));
+#else
+    (void) nodes;
+    (void) unit;
+#endif
+}
@@ -1,5 +1,6 @@
 #include "defs.h"
 
+#include <stdio.h>  // printf, putchar
 #include <string.h> // memset
 
 #define INFINITY 2000000000
@@ -19,7 +20,10 @@
 int isRepetition(const Board* board) {
     assert(checkBoard(board));
     int start = board->ply - 2;
+    // a position set up from a FEN can have a fifty move count that goes
+    // back further than the moves in its history
     int end = board->ply - board->fiftyMoveCount;
+    end = end > 0 ? end : 0;
     for (int i = start; i >= end; i -= 2) {
         assert(i >= 0);
         if (board->positionKey == board->history[i].positionKey) {
@@ -38,22 +42,35 @@ int isRepetition(const Board* board) {
  * with moveExists() due to the possibility of Zobrist hashing collisions. We
  * return the length of the pv line. This will usually be 'depth' (the max
  * depth that we have gone with alpha-beta so far), but it could be lower in
- * the case of a collision.
+ * the case of a collision. Each move found in the table and each collision
+ * (a move that is not legal in the position) is counted in the search info.
  * 
  * board:      The board whose pvArray we are filling.
+ * info:       The search info that counts the table hits and collisions, or
+ *             NULL if they should not be counted.
  * depth:      The max length of our pv line. This is how deep we have searched
  *             with alpha-beta for the current position so far.
  * 
  * return:     The length of the pv line that was found in the hash table.
  */
-int fillpvArray(Board* board, int depth) {
+int fillpvArray(Board* board, SearchInfo* info, int depth) {
     assert(board != NULL);
     assert(depth < MAX_SEARCH_DEPTH);
     int movesFound = 0;
     while (movesFound < depth) {
+        PROFILE_BEGIN(PHASE_HASH);
         int move = retrieveMove(&board->pvTable, board->positionKey);
-        if (move == 0 || !moveExists(board, move)) {
-            // TODO: add print statements to see how often collisions occur
+        PROFILE_END();
+        if (move == 0) {
+            break;
+        }
+        if (info != NULL) {
+            ++info->pvHits;
+        }
+        if (!moveExists(board, move)) {
+            if (info != NULL) {
+                ++info->pvCollisions;
+            }
             break;
         }
         makeMove(board, move);
@@ -75,10 +92,43 @@ static void clearForSearch(Board* board, SearchInfo* info) {
     assert(checkBoard(board));
     memset(board->searchHistory, 0, sizeof(int) * NUM_PIECE_TYPES * 64);
     memset(board->searchKillers, 0, sizeof(int) * 2 * MAX_SEARCH_DEPTH);
-    clearHashTable(&board->pvTable);
+    ageHashTable(&board->pvTable);
     board->searchPly = 0;
     info->startTime = getTime();
     info->nodes = info->stopped = info->failHigh = info->failHighFirst = 0;
+    info->evalProbes = info->evalHits = 0;
+    info->pvHits = info->pvCollisions = 0;
+    memset(info->cutoffIndex, 0, sizeof(info->cutoffIndex));
+}
+
+/*
+ * Return the static evaluation of the board from the perspective of the side
+ * to move. Look in the board's evaluation cache first, since the same
+ * position is often reached again through transpositions and in later
+ * iterations of iterative deepening. If it is not there, evaluate the board
+ * and store the evaluation in the cache.
+ *
+ * board:      The board that is being evaluated.
+ * info:       The search info. Keeps track of the cache probes and hits.
+ *
+ * return:     The static evaluation of the board.
+ */
+static int evaluate(Board* board, SearchInfo* info) {
+    int eval;
+    ++info->evalProbes;
+    PROFILE_BEGIN(PHASE_HASH);
+    if (probeEvalCache(&board->evalCache, board->positionKey, &eval)) {
+        PROFILE_END();
+        ++info->evalHits;
+        assert(eval == evaluatePosition(board));
+        return eval;
+    }
+    PROFILE_SWITCH(PHASE_EVAL);
+    eval = evaluatePosition(board);
+    PROFILE_SWITCH(PHASE_HASH);
+    storeEvalCache(&board->evalCache, board->positionKey, eval);
+    PROFILE_END();
+    return eval;
 }
 
 // eliminates the horizon effect by going through all capture moves in a position
@@ -97,7 +147,7 @@ static int alphaBeta(Board* board, SearchInfo* info, int alpha, int beta, int de
 	++info->nodes;
 
 	if (depth == 0) {
-		return evaluatePosition(board);
+		return evaluate(board, info);
 	}
 	
 	if (isRepetition(board) || board->fiftyMoveCount >= 100) {
@@ -105,7 +155,7 @@ static int alphaBeta(Board* board, SearchInfo* info, int alpha, int beta, int de
 	}
 	
 	if(board->searchPly >= MAX_SEARCH_DEPTH) {
-		return evaluatePosition(board);
+		return evaluate(board, info);
 	}
 	
 	MoveList list;
@@ -131,6 +181,8 @@ static int alphaBeta(Board* board, SearchInfo* info, int alpha, int beta, int de
                     ++info->failHighFirst;
                 }
                 ++info->failHigh;
+                ++info->cutoffIndex[legal < CUTOFF_HISTOGRAM_SIZE
+                    ? legal - 1 : CUTOFF_HISTOGRAM_SIZE - 1];
 				return beta;
 			}
 			alpha = score;
@@ -148,24 +200,109 @@ static int alphaBeta(Board* board, SearchInfo* info, int alpha, int beta, int de
 	}
 	
 	if (alpha != oldAlpha) {
-        storeMove(&board->pvTable, bestMove, board->positionKey);
+        PROFILE_BEGIN(PHASE_HASH);
+        storeMove(&board->pvTable, bestMove, board->positionKey, depth);
+        PROFILE_END();
 	}
 	
 	return alpha;
 }
 
+/*
+ * Print the statistics of one iteration of iterative deepening on a single
+ * line, as JSON (info->statsFormat = STATS_JSON) or as a UCI "info string"
+ * (STATS_UCI), for scripts that tune the search. The counts are for this
+ * iteration only: the difference between the search info now and at the
+ * start of the iteration ('before'), except for total_nodes.
+ *
+ * nodes:           The nodes searched in the iteration.
+ * ebf:             The effective branching factor, the nodes of this
+ *                  iteration divided by the nodes of the last one (0 at depth
+ *                  1).
+ * cutoff_rate:     The beta cutoffs per node.
+ * ordering:        The share of the beta cutoffs caused by the first move.
+ * cutoff_index:    How many cutoffs were caused by the 1st, 2nd, ... legal
+ *                  move (the last bucket counts every later move).
+ * eval_cache:      The evaluation cache probes and the hit rate.
+ * pv_table:        The pv table hits and collisions while finding the pv.
+ *
+ * board:           The board after the iteration, with the pv in pvArray.
+ * info:            The search info after the iteration.
+ * before:          A copy of the search info from before the iteration.
+ * previousNodes:   The nodes of the last iteration, or 0 at depth 1.
+ * depth, score:    The depth and score of the iteration.
+ * numMoves:        The length of the pv.
+ * time:            The time the iteration took, in nanoseconds.
+ */
+static void printIterationStats(const Board* board, const SearchInfo* info,
+    const SearchInfo* before, long long previousNodes, int depth, int score,
+    int numMoves, uint64 time) {
+    int json = info->statsFormat == STATS_JSON;
+    long long nodes = info->nodes - before->nodes;
+    double failHigh = info->failHigh - before->failHigh;
+    double failHighFirst = info->failHighFirst - before->failHighFirst;
+    long long evalProbes = info->evalProbes - before->evalProbes;
+    long long evalHits = info->evalHits - before->evalHits;
+    printf(json ? "{\"depth\": %d, \"score\": %d, \"time_us\": %llu, "
+        "\"nodes\": %lld, \"total_nodes\": %lld, \"nps\": %llu, "
+        "\"ebf\": %.3f, " : "info string depth %d score %d time_us %llu "
+        "nodes %lld total_nodes %lld nps %llu ebf %.3f ",
+        depth, score, time / 1000, nodes, info->nodes,
+        time == 0 ? 0ULL : (uint64) nodes * 1000000000ULL / time,
+        previousNodes == 0 ? 0.0 : (double) nodes / previousNodes);
+    printf(json ? "\"cutoff_rate\": %.4f, \"ordering\": %.4f, "
+        "\"cutoff_index\": [" : "cutoff_rate %.4f ordering %.4f "
+        "cutoff_index ", nodes == 0 ? 0.0 : failHigh / nodes,
+        failHigh == 0 ? 0.0 : failHighFirst / failHigh);
+    for (int i = 0; i < CUTOFF_HISTOGRAM_SIZE; ++i) {
+        printf(i == 0 ? "%lld" : json ? ", %lld" : ",%lld",
+            info->cutoffIndex[i] - before->cutoffIndex[i]);
+    }
+    printf(json ? "], \"eval_cache\": {\"probes\": %lld, \"hit_rate\": "
+        "%.4f}, \"pv_table\": {\"hits\": %lld, \"collisions\": %lld}, "
+        "\"pv\": \"" : " eval_probes %lld eval_hit_rate %.4f pv_hits %lld "
+        "pv_collisions %lld pv", evalProbes,
+        evalProbes == 0 ? 0.0 : (double) evalHits / evalProbes,
+        info->pvHits - before->pvHits,
+        info->pvCollisions - before->pvCollisions);
+    for (int i = 0; i < numMoves; ++i) {
+        char moveString[6];
+        getMoveString(board->pvArray[i], moveString);
+        printf(json && i == 0 ? "%s" : " %s", moveString);
+    }
+    puts(json ? "\"}" : "");
+    fflush(stdout);
+}
+
 // handles iterative deepening
 void searchPosition(Board* board, SearchInfo* info) {
     assert(checkBoard(board));
     clearForSearch(board, info);
+    startPhaseProfile();
+    long long previousNodes = 0;
     for (int depth = 1; depth <= info->depth; ++depth) {
+        SearchInfo before = *info;
+        uint64 startTime = getTimeNs();
         int score = alphaBeta(board, info, -INFINITY, INFINITY, depth, 1);
+        uint64 time = getTimeNs() - startTime;
 
         // check if we are out of time
 
-        // print stuff
+        // print stuff, unless the search is quiet (Ex: for the bench) and
+        // no statistics were asked for
+        if (info->quiet && info->statsFormat == STATS_NONE) {
+            continue;
+        }
+        int numMoves = fillpvArray(board, info, depth);
+        if (info->statsFormat != STATS_NONE) {
+            printIterationStats(board, info, &before, previousNodes, depth,
+                score, numMoves, time);
+        }
+        previousNodes = info->nodes - before.nodes;
+        if (info->quiet) {
+            continue;
+        }
         printf("depth: %d, score: %d, nodes: %lld\n", depth, score, info->nodes);
-        int numMoves = fillpvArray(board, depth);
 		printf("pv line of %d moves:", numMoves);
 		for (int i = 0; i < numMoves; ++i) {
 			char moveString[6];
@@ -176,5 +313,15 @@ void searchPosition(Board* board, SearchInfo* info) {
         printf("fail high: %.2f\n", info->failHigh);
         printf("fail high first: %.2f\n", info->failHighFirst);
         printf("Ordering: %.2f\n", info->failHighFirst / info->failHigh);
+        printf("eval cache: %lld hits / %lld probes (%.2f)\n", info->evalHits,
+            info->evalProbes, info->evalProbes == 0 ? 0.0
+            : (double) info->evalHits / info->evalProbes);
+        printf("pv table: %lld collisions / %lld hits\n", info->pvCollisions,
+            info->pvHits);
+    }
+    // the bench prints the profile of all of its searches at the end
+    stopPhaseProfile();
+    if (!info->quiet) {
+        printPhaseProfile((uint64) info->nodes, "node");
     }
 }
@@ -0,0 +1,567 @@
+#include "defs.h"
+
+#include <math.h>    // exp, log, pow, sqrt, floor
+#include <stdio.h>   // printf, puts, fopen, fread, fprintf, fclose
+#include <stdlib.h>  // malloc, free, strtod, atoi
+#include <string.h>  // memset, memcpy, strchr, strstr
+
+#include "libs/tinycthread.h"
+
+/*
+ * A Texel tuner for the material values and piece-square tables in
+ * evaluate.c. The tuner loads a set of positions labeled with the result of
+ * the game they came from (1 for a white win, 0.5 for a draw, 0 for a black
+ * win) and finds the table values that best predict the results. The
+ * prediction for a position is sigmoid(K * eval / 400), where eval is the
+ * evaluation from white's perspective and K is a scaling constant that is
+ * fitted to the data before tuning. The loss is the mean squared error
+ * between the predictions and the results.
+ *
+ * Each position is first resolved with a quiescence search so that the
+ * tuned position is quiet (no captures that change the material are
+ * pending). Only the material and piece-square part of the evaluation is
+ * tuned: pieceValue[phase][piece][sq] is the same for a white piece on sq and
+ * a black piece on sq ^ 56, so there are 6 * 64 parameters for each phase. The
+ * evaluation is linear in these parameters, so each position only stores
+ * which parameters it uses (one per piece) and the terms that are not tuned
+ * (the pawn structure and the material imbalance) as a fixed offset. The draw
+ * scaling and the known endgames in material.c are not part of the model.
+ *
+ * The loss and its gradient are computed by splitting the positions between
+ * threads. Every thread writes into its own preallocated gradient, so nothing
+ * is allocated while tuning. The parameters are updated with Adam.
+ *
+ * Usage: tuner <positions.epd> <output.c> [epochs] [threads]
+ *
+ * Each line of the positions file is an EPD or FEN followed by the result in
+ * one of these forms: "1-0", "1/2-1/2", "0-1", or [1.0], [0.5], [0.0]. The
+ * tuned tables are written to the output file as C code that can replace the
+ * tables in evaluate.c.
+ */
+#define MAX_THREADS 128
+#define NUM_PARAMS (6 * 64)
+#define MAX_PIECES 32
+#define BLACK_FEATURE 0x8000
+#define MAX_QUIESCENCE_DEPTH 16
+#define SCORE_BOUND 32000
+#define DEFAULT_EPOCHS 500
+#define LEARNING_RATE 1.0
+#define BETA1 0.9
+#define BETA2 0.999
+#define EPSILON 1e-8
+
+/*
+ * A position from the data set after it has been resolved.
+ *
+ * result:       The result of the game from white's perspective (1, 0.5, 0).
+ * phase:        The game phase of the position, capped at MAX_PHASE.
+ * numFeatures:  The number of pieces on the board.
+ * offset:       The middlegame and endgame terms that are not tuned, from
+ *               white's perspective.
+ * features:     For each piece, the parameter that it uses (type * 64 +
+ *               square, with the square mirrored for black), plus
+ *               BLACK_FEATURE if the piece is black.
+ */
+typedef struct {
+    float result;
+    unsigned char phase;
+    unsigned char numFeatures;
+    short offset[2];
+    unsigned short features[MAX_PIECES];
+} TunerPosition;
+
+/*
+ * The work given to one thread: a range of positions (or of lines of the
+ * positions file while loading) and the thread's part of the loss and the
+ * gradient.
+ */
+typedef struct {
+    int start;
+    int end;
+    int computeGradient;
+    double loss;
+    double gradient[2][NUM_PARAMS];
+} TunerThread;
+
+static double params[2][NUM_PARAMS];
+static double adamM[2][NUM_PARAMS];
+static double adamV[2][NUM_PARAMS];
+static double scalingK = 1.0;
+
+static TunerPosition* positions;
+static int numPositions;
+static char** lines;
+
+static int numThreads;
+static thrd_t threads[MAX_THREADS];
+static TunerThread work[MAX_THREADS];
+static Board boards[MAX_THREADS];
+
+/*
+ * Split 'count' items evenly between the threads, run 'function' on every
+ * thread, and wait for all of them to finish. A thread function returns 0 if
+ * it succeeded. Return 1 if every thread ran and succeeded, 0 otherwise.
+ */
+static int runThreads(int (*function)(void*), int count) {
+    for (int i = 0; i < numThreads; ++i) {
+        work[i].start = (int) ((long long) count * i / numThreads);
+        work[i].end = (int) ((long long) count * (i + 1) / numThreads);
+        if (thrd_create(&threads[i], function, &work[i]) != thrd_success) {
+            printf("Error: runThreads: could not create thread %d\n", i);
+            for (int j = 0; j < i; ++j) {
+                thrd_join(threads[j], NULL);
+            }
+            return 0;
+        }
+    }
+    int succeeded = 1;
+    for (int i = 0; i < numThreads; ++i) {
+        int result;
+        if (thrd_join(threads[i], &result) != thrd_success || result != 0) {
+            printf("Error: runThreads: thread %d failed\n", i);
+            succeeded = 0;
+        }
+    }
+    return succeeded;
+}
+
+/*
+ * Find the result at the end of a line of the positions file. Return the
+ * result from white's perspective, or -1 if the line has no result.
+ */
+static float parseResult(const char* line) {
+    const char* bracket = strchr(line, '[');
+    if (bracket != NULL) {
+        return (float) strtod(bracket + 1, NULL);
+    }
+    if (strstr(line, "1/2-1/2") != NULL) {
+        return 0.5f;
+    }
+    if (strstr(line, "1-0") != NULL) {
+        return 1.0f;
+    }
+    if (strstr(line, "0-1") != NULL) {
+        return 0.0f;
+    }
+    return -1.0f;
+}
+
+/*
+ * Search captures until the position is quiet and return the score from the
+ * perspective of the side to move. The moves of the best capture sequence
+ * are stored in pv[] so that the quiet position at the end of it can be
+ * reached.
+ */
+static int quiescence(Board* board, int alpha, int beta, int depth, int* pv,
+    int* pvLength) {
+    *pvLength = 0;
+    int standPat = evaluatePosition(board);
+    if (standPat >= beta) {
+        return beta;
+    }
+    if (standPat > alpha) {
+        alpha = standPat;
+    }
+    if (depth >= MAX_QUIESCENCE_DEPTH) {
+        return alpha;
+    }
+    MoveList list;
+    generateAllMoves(board, &list);
+    int childPv[MAX_QUIESCENCE_DEPTH];
+    int childLength;
+    for (int moveNum = 0; moveNum < list.numMoves; ++moveNum) {
+        int move = list.moves[moveNum];
+        if (!(move & CAPTURE_FLAG) || !makeMove(board, move)) {
+            continue;
+        }
+        int score = -quiescence(board, -beta, -alpha, depth + 1, childPv,
+            &childLength);
+        undoMove(board);
+        if (score > alpha) {
+            if (score >= beta) {
+                return beta;
+            }
+            alpha = score;
+            pv[0] = move;
+            memcpy(pv + 1, childPv, sizeof(int) * childLength);
+            *pvLength = childLength + 1;
+        }
+    }
+    return alpha;
+}
+
+/*
+ * Set the board to the position on the given line, resolve it with a
+ * quiescence search, and store the quiet position's features in 'position'.
+ * setBoardToFen() ignores whatever follows the position, so the line is
+ * passed to it as it is. Return 1 if the line held a valid position, 0
+ * otherwise.
+ */
+static int resolvePosition(Board* board, const char* line,
+    TunerPosition* position) {
+    float result = parseResult(line);
+    if (result < 0.0f || !setBoardToFen(board, line)) {
+        return 0;
+    }
+    int pv[MAX_QUIESCENCE_DEPTH], pvLength;
+    quiescence(board, -SCORE_BOUND, SCORE_BOUND, 0, pv, &pvLength);
+    for (int i = 0; i < pvLength; ++i) {
+        makeMove(board, pv[i]);
+    }
+
+    position->result = result;
+    position->phase = (unsigned char) (board->phase < MAX_PHASE
+        ? board->phase : MAX_PHASE);
+    position->numFeatures = 0;
+    for (int sq = 0; sq < 64; ++sq) {
+        int piece = board->pieces[sq];
+        if (piece == NO_PIECE || position->numFeatures == MAX_PIECES) {
+            continue;
+        }
+        int feature = (piece % 6) * 64
+            + (pieceColor[piece] == WHITE ? sq : (sq ^ 56) | BLACK_FEATURE);
+        position->features[position->numFeatures++] = (unsigned short) feature;
+    }
+    const PawnEntry* pawns = probePawnTable(board);
+    const MaterialEntry* materialEntry = probeMaterialTable(board);
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        position->offset[phase] = (short) (pawns->score[phase]
+            + materialEntry->imbalance);
+    }
+    return 1;
+}
+
+/*
+ * Thread function that resolves the lines in the thread's range. Positions
+ * are stored at the index of their line; invalid lines get a result of -1
+ * and are removed afterwards. If the board can't be set up, every line in
+ * the range is marked as invalid and the thread fails.
+ */
+static int resolveThread(void* args) {
+    TunerThread* thread = (TunerThread*) args;
+    Board* board = &boards[thread - work];
+    if (!initBoardTables(board)) {
+        for (int i = thread->start; i < thread->end; ++i) {
+            positions[i].result = -1.0f;
+        }
+        return 1;
+    }
+    for (int i = thread->start; i < thread->end; ++i) {
+        if (!resolvePosition(board, lines[i], &positions[i])) {
+            positions[i].result = -1.0f;
+        }
+    }
+    freeBoardTables(board);
+    return 0;
+}
+
+/*
+ * Load every position in the file into memory. The whole file is read at
+ * once and split into lines, which are then resolved in parallel. Return the
+ * number of positions loaded, or 0 if something went wrong.
+ */
+static int loadPositions(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        puts("Error: loadPositions: Could not open the positions file.");
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = (char*) malloc(size + 1);
+    if (text == NULL || fread(text, 1, size, file) != (size_t) size) {
+        puts("Error: loadPositions: Could not read the positions file.");
+        free(text);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    text[size] = '\0';
+
+    int numLines = 0;
+    for (long i = 0; i < size; ++i) {
+        numLines += text[i] == '\n';
+    }
+    ++numLines;
+    lines = (char**) malloc(sizeof(char*) * numLines);
+    positions = (TunerPosition*) malloc(sizeof(TunerPosition) * numLines);
+    if (lines == NULL || positions == NULL) {
+        puts("Error: loadPositions: Not enough memory for the positions.");
+        free(text);
+        return 0;
+    }
+    numLines = 0;
+    for (char* line = text; line != NULL; ) {
+        lines[numLines++] = line;
+        line = strchr(line, '\n');
+        if (line != NULL) {
+            *line++ = '\0';
+        }
+    }
+
+    if (!runThreads(resolveThread, numLines)) {
+        puts("Error: loadPositions: Could not resolve the positions.");
+        free(lines);
+        free(text);
+        return 0;
+    }
+    numPositions = 0;
+    for (int i = 0; i < numLines; ++i) {
+        if (positions[i].result >= 0.0f) {
+            positions[numPositions++] = positions[i];
+        }
+    }
+    free(lines);
+    free(text);
+    return numPositions;
+}
+
+/*
+ * Thread function that adds up the loss (and the gradient of the loss, if
+ * computeGradient is set) over the positions in the thread's range.
+ */
+static int lossThread(void* args) {
+    TunerThread* thread = (TunerThread*) args;
+    const double logScale = scalingK * log(10.0) / 400.0;
+    thread->loss = 0.0;
+    if (thread->computeGradient) {
+        memset(thread->gradient, 0, sizeof(thread->gradient));
+    }
+    for (int i = thread->start; i < thread->end; ++i) {
+        const TunerPosition* position = &positions[i];
+        double score[2] = { position->offset[MIDDLEGAME],
+            position->offset[ENDGAME] };
+        for (int f = 0; f < position->numFeatures; ++f) {
+            int feature = position->features[f];
+            int index = feature & ~BLACK_FEATURE;
+            double sign = feature & BLACK_FEATURE ? -1.0 : 1.0;
+            score[MIDDLEGAME] += sign * params[MIDDLEGAME][index];
+            score[ENDGAME] += sign * params[ENDGAME][index];
+        }
+        double mgWeight = (double) phaseScale[position->phase]
+            / (1 << PHASE_SHIFT);
+        double eval = score[MIDDLEGAME] * mgWeight
+            + score[ENDGAME] * (1.0 - mgWeight);
+        double prediction = 1.0 / (1.0 + exp(-logScale * eval));
+        double error = position->result - prediction;
+        thread->loss += error * error;
+        if (!thread->computeGradient) {
+            continue;
+        }
+        double slope = -2.0 * error * prediction * (1.0 - prediction)
+            * logScale;
+        for (int f = 0; f < position->numFeatures; ++f) {
+            int feature = position->features[f];
+            int index = feature & ~BLACK_FEATURE;
+            double sign = feature & BLACK_FEATURE ? -1.0 : 1.0;
+            thread->gradient[MIDDLEGAME][index] += sign * slope * mgWeight;
+            thread->gradient[ENDGAME][index] += sign * slope
+                * (1.0 - mgWeight);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Compute the mean loss over every position and store it in 'loss'. If
+ * 'gradient' is not NULL, the gradient of the mean loss is stored in it.
+ * Return 1 on success, 0 if the threads could not be run (the loss and the
+ * gradient are then not set).
+ */
+static int computeLoss(double gradient[2][NUM_PARAMS], double* loss) {
+    for (int i = 0; i < numThreads; ++i) {
+        work[i].computeGradient = gradient != NULL;
+    }
+    if (!runThreads(lossThread, numPositions)) {
+        puts("Error: computeLoss: Could not compute the loss.");
+        return 0;
+    }
+    *loss = 0.0;
+    if (gradient != NULL) {
+        memset(gradient, 0, sizeof(double) * 2 * NUM_PARAMS);
+    }
+    for (int i = 0; i < numThreads; ++i) {
+        *loss += work[i].loss;
+        for (int p = 0; gradient != NULL && p < NUM_PARAMS; ++p) {
+            gradient[MIDDLEGAME][p] += work[i].gradient[MIDDLEGAME][p];
+            gradient[ENDGAME][p] += work[i].gradient[ENDGAME][p];
+        }
+    }
+    for (int p = 0; gradient != NULL && p < NUM_PARAMS; ++p) {
+        gradient[MIDDLEGAME][p] /= numPositions;
+        gradient[ENDGAME][p] /= numPositions;
+    }
+    *loss /= numPositions;
+    return 1;
+}
+
+/*
+ * Find the scaling constant K that minimizes the loss with the current
+ * parameters. K is searched for on a grid that gets 10 times finer each
+ * round around the best value found so far. Return 1 on success, 0 if the
+ * loss could not be computed.
+ */
+static int findScalingConstant() {
+    double best = 1.0, step = 1.0, bestLoss, loss;
+    scalingK = best;
+    if (!computeLoss(NULL, &bestLoss)) {
+        return 0;
+    }
+    for (int round = 0; round < 4; ++round) {
+        double center = best;
+        for (int i = -9; i <= 9; ++i) {
+            scalingK = center + i * step;
+            if (scalingK <= 0.0) {
+                continue;
+            }
+            if (!computeLoss(NULL, &loss)) {
+                return 0;
+            }
+            if (loss < bestLoss) {
+                bestLoss = loss;
+                best = scalingK;
+            }
+        }
+        step /= 10.0;
+    }
+    scalingK = best;
+    return 1;
+}
+
+/*
+ * Update the parameters with one step of Adam using the given gradient.
+ */
+static void adamStep(double gradient[2][NUM_PARAMS], int step) {
+    double correction1 = 1.0 - pow(BETA1, step);
+    double correction2 = 1.0 - pow(BETA2, step);
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        for (int p = 0; p < NUM_PARAMS; ++p) {
+            double g = gradient[phase][p];
+            adamM[phase][p] = BETA1 * adamM[phase][p] + (1.0 - BETA1) * g;
+            adamV[phase][p] = BETA2 * adamV[phase][p] + (1.0 - BETA2) * g * g;
+            double m = adamM[phase][p] / correction1;
+            double v = adamV[phase][p] / correction2;
+            params[phase][p] -= LEARNING_RATE * m / (sqrt(v) + EPSILON);
+        }
+    }
+}
+
+/*
+ * Write the tuned parameters to a file as the materialValue and
+ * pieceSquareTable arrays of evaluate.c. The material value of each piece
+ * type is the average of its parameters over the squares it can stand on
+ * (pawns are never on rank 1 or 8), and the piece-square values are the
+ * parameters minus the material value. Return 1 on success, 0 otherwise.
+ */
+static int writeTables(const char* path) {
+    static const char* phaseNames[2] = { "middlegame", "endgame" };
+    static const char* typeNames[6] = {
+        "pawn", "knight", "bishop", "rook", "queen", "king"
+    };
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        puts("Error: writeTables: Could not open the output file.");
+        return 0;
+    }
+    int materialValue[2][6], table[2][6][64];
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        for (int type = 0; type < 6; ++type) {
+            int first = type == 0 ? 8 : 0, last = type == 0 ? 56 : 64;
+            double sum = 0.0;
+            for (int sq = first; sq < last; ++sq) {
+                sum += params[phase][type * 64 + sq];
+            }
+            materialValue[phase][type] = type == 5 ? 0
+                : (int) floor(sum / (last - first) + 0.5);
+            for (int sq = 0; sq < 64; ++sq) {
+                int value = (int) floor(params[phase][type * 64 + sq] + 0.5);
+                table[phase][type][sq] = sq < first || sq >= last ? 0
+                    : value - materialValue[phase][type];
+            }
+        }
+    }
+    fprintf(file, "static const int materialValue[2][6] = {\n");
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        fprintf(file, "    {");
+        for (int type = 0; type < 6; ++type) {
+            fprintf(file, " %d%s", materialValue[phase][type],
+                type < 5 ? "," : " ");
+        }
+        fprintf(file, "},  // %s\n", phaseNames[phase]);
+    }
+    fprintf(file, "};\n\nstatic const int pieceSquareTable[2][6][64] = {\n");
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        fprintf(file, "    { // %s\n", phaseNames[phase]);
+        for (int type = 0; type < 6; ++type) {
+            fprintf(file, "        { // %s\n", typeNames[type]);
+            for (int sq = 0; sq < 64; ++sq) {
+                fprintf(file, "%s%4d,%s", sq % 8 == 0 ? "           " : "",
+                    table[phase][type][sq], sq % 8 == 7 ? "\n" : "");
+            }
+            fprintf(file, "        },\n");
+        }
+        fprintf(file, "    },\n");
+    }
+    fprintf(file, "};\n");
+    fclose(file);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        puts("Usage: tuner <positions.epd> <output.c> [epochs] [threads]");
+        return -1;
+    }
+    int epochs = argc > 3 ? atoi(argv[3]) : DEFAULT_EPOCHS;
+    numThreads = argc > 4 ? atoi(argv[4]) : countProcessors();
+    numThreads = numThreads < 1 ? 1 : numThreads;
+    numThreads = numThreads > MAX_THREADS ? MAX_THREADS : numThreads;
+    initializeAll();
+
+    // Start from the current tables, seen from white's perspective.
+    for (int phase = MIDDLEGAME; phase <= ENDGAME; ++phase) {
+        for (int type = 0; type < 6; ++type) {
+            for (int sq = 0; sq < 64; ++sq) {
+                params[phase][type * 64 + sq] = pieceValue[phase][type][sq];
+            }
+        }
+    }
+
+    uint64 startTime = getTime();
+    if (loadPositions(argv[1]) == 0) {
+        puts("No positions were loaded.");
+        return -1;
+    }
+    printf("Loaded %d positions with %d threads in %llu ms\n", numPositions,
+        numThreads, getTime() - startTime);
+    double loss;
+    if (!findScalingConstant() || !computeLoss(NULL, &loss)) {
+        free(positions);
+        return -1;
+    }
+    printf("K = %.4f, loss = %.6f\n", scalingK, loss);
+
+    static double gradient[2][NUM_PARAMS];
+    startTime = getTime();
+    for (int epoch = 1; epoch <= epochs; ++epoch) {
+        if (!computeLoss(gradient, &loss)) {
+            puts("Error: main: Tuning stopped, no tables were written.");
+            free(positions);
+            return -1;
+        }
+        adamStep(gradient, epoch);
+        if (epoch % 50 == 0 || epoch == 1) {
+            printf("epoch %d: loss = %.6f (%llu ms)\n", epoch, loss,
+                getTime() - startTime);
+            fflush(stdout);
+        }
+    }
+    if (!computeLoss(NULL, &loss)) {
+        free(positions);
+        return -1;
+    }
+    printf("final loss = %.6f\n", loss);
+    free(positions);
+    return writeTables(argv[2]) ? 0 : -1;
+}